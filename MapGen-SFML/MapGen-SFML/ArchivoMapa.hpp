@@ -0,0 +1,394 @@
+#ifndef ARCHIVOMAPA_HPP
+#define ARCHIVOMAPA_HPP
+
+#include <SFML\Graphics.hpp>
+#include <Windows.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <string.h>
+#include "Map.hpp"
+#include "CodecAlturas.hpp"
+
+/*
+* Guarda y carga mapas de alturas en un formato binario propio:
+*
+*	- Una cabecera de tamano fijo (Cabecera) con la marca "MGSH", la version del formato, el detalle, la semilla, el
+*	  roughness, la altura minima y maxima y el tipo con el que se guardan las alturas.
+*	- Relleno hasta el byte INICIO_ALTURAS (4096, un multiplo del tamano de pagina).
+*	- Las size*size alturas, fila a fila como en Map::map.
+*
+* Con alturas FLOAT32 el archivo se proyecta en memoria y el Map usa las alturas directamente desde la proyeccion,
+* sin leerlas a un buffer propio ni convertirlas (las paginas se leen del disco segun se van tocando). Aun asi, preparar
+* el dibujo (trozos y niveles de detalle) recorre todas las alturas una vez al abrir. La proyeccion es copy-on-write:
+* editar el mapa no modifica el archivo.
+* Guardar escribe un archivo temporal y lo renombra al final, asi que un archivo a medias nunca sustituye a uno bueno.
+* Con alturas UINT8 (los mapas generados solo tienen alturas enteras entre 0 y 255) el archivo ocupa la cuarta parte
+* pero hay que leerlo y convertirlo al cargar.
+* Con alturas COMPRIMIDO lo que sigue a la cabecera es un mapa comprimido con CodecAlturas, sin perdidas y para
+* cualquier altura (suele ocupar bastante menos que UINT8); al cargar se descomprime en varios hilos.
+* Todos los campos se guardan en little-endian, el orden de la maquina
+*/
+class ArchivoMapa {
+public:
+
+	enum Tipo { FLOAT32 = 0, UINT8 = 1, COMPRIMIDO = 2 };
+
+	static const sf::Uint32 VERSION = 1;
+	static const sf::Uint32 INICIO_ALTURAS = 4096;
+
+	struct Cabecera {
+		char marca[4];
+		sf::Uint32 version;
+		sf::Uint32 detalle;
+		sf::Int32 semilla;
+		float roughness;
+		float alturaMin;
+		float alturaMax;
+		sf::Uint32 tipo;
+		sf::Uint32 inicioAlturas;
+		sf::Uint32 reservado[7];
+	};
+
+private:
+
+	/**
+	* Bytes de cada altura en el archivo (0 si van comprimidas y no tienen tamano fijo)
+	*/
+	static int bytesAltura(sf::Uint32 tipo){
+		return (tipo == UINT8) ? 1 : (tipo == COMPRIMIDO) ? 0 : 4;
+	}
+
+	/**
+	* Comprueba una cabecera leida del disco. Devuelve el size del mapa o -1 si no es valida
+	*/
+	static int compruebaCabecera(const Cabecera &c, sf::Int64 tamArchivo, const std::string &ruta){
+		if (memcmp(c.marca, "MGSH", 4) != 0){
+			std::cout << ruta << ": no es un archivo de mapa" << std::endl;
+			return -1;
+		}
+		if (c.version != VERSION){
+			std::cout << ruta << ": version " << c.version << " no soportada" << std::endl;
+			return -1;
+		}
+		if (c.detalle < 1 || c.detalle > 15 || c.tipo > COMPRIMIDO || c.inicioAlturas < sizeof(Cabecera)){
+			std::cout << ruta << ": cabecera incorrecta" << std::endl;
+			return -1;
+		}
+		int size = (1 << c.detalle) + 1;
+		sf::Int64 necesario = (sf::Int64)c.inicioAlturas + (sf::Int64)size * size * bytesAltura(c.tipo);
+		if (tamArchivo < necesario || tamArchivo <= (sf::Int64)c.inicioAlturas){
+			std::cout << ruta << ": archivo truncado" << std::endl;
+			return -1;
+		}
+		return size;
+	}
+
+	/**
+	* Completa un Map recien cargado con los datos de la cabecera y lo prepara para dibujar
+	*/
+	static void terminaCarga(Map *m, const Cabecera &c){
+		m->minHeight = (int)c.alturaMin;
+		m->maxHeight = (int)c.alturaMax;
+		m->inicializaDibujo();
+	}
+
+	/**
+	* Carga un archivo FLOAT32 proyectandolo en memoria
+	*/
+	static Map *proyecta(const std::string &ruta){
+		HANDLE archivo = CreateFileA(ruta.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+		if (archivo == INVALID_HANDLE_VALUE){
+			return nullptr;
+		}
+		LARGE_INTEGER tam;
+		GetFileSizeEx(archivo, &tam);
+		HANDLE proyeccion = CreateFileMappingA(archivo, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (proyeccion == NULL){
+			std::cout << ruta << ": no se puede proyectar (" << GetLastError() << ")" << std::endl;
+			CloseHandle(archivo);
+			return nullptr;
+		}
+		void *vista = MapViewOfFile(proyeccion, FILE_MAP_COPY, 0, 0, 0);
+		if (vista == NULL){
+			std::cout << ruta << ": no se puede proyectar (" << GetLastError() << ")" << std::endl;
+			CloseHandle(proyeccion);
+			CloseHandle(archivo);
+			return nullptr;
+		}
+		const Cabecera &c = *(const Cabecera*)vista;
+		if (compruebaCabecera(c, tam.QuadPart, ruta) < 0){
+			UnmapViewOfFile(vista);
+			CloseHandle(proyeccion);
+			CloseHandle(archivo);
+			return nullptr;
+		}
+		float *alturas = (float*)((char*)vista + c.inicioAlturas);
+		Map *m = new Map(c.detalle, c.semilla, c.roughness, alturas);
+		m->vista = vista;
+		m->archivo = archivo;
+		m->proyeccion = proyeccion;
+		terminaCarga(m, c);
+		return m;
+	}
+
+	/**
+	* true si ruta es el mismo archivo que el abierto en archivo (aunque se haya escrito de otra forma)
+	*/
+	static bool mismoArchivo(HANDLE archivo, const std::string &ruta){
+		HANDLE otro = CreateFileA(ruta.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (otro == INVALID_HANDLE_VALUE){
+			return false;
+		}
+		BY_HANDLE_FILE_INFORMATION a, b;
+		bool mismo = GetFileInformationByHandle(archivo, &a) && GetFileInformationByHandle(otro, &b) &&
+			a.dwVolumeSerialNumber == b.dwVolumeSerialNumber && a.nFileIndexHigh == b.nFileIndexHigh &&
+			a.nFileIndexLow == b.nFileIndexLow;
+		CloseHandle(otro);
+		return mismo;
+	}
+
+	/**
+	* Pone el archivo temporal ya escrito en el sitio de ruta, reemplazandolo si existe
+	*/
+	static bool reemplaza(const std::string &temporal, const std::string &ruta){
+		if (!MoveFileExA(temporal.c_str(), ruta.c_str(), MOVEFILE_REPLACE_EXISTING)){
+			std::cout << ruta << ": no se puede reemplazar (" << GetLastError() << ")" << std::endl;
+			DeleteFileA(temporal.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Crea el archivo y escribe la cabecera (con su relleno hasta inicioAlturas)
+	*/
+	static bool abre(std::ofstream &f, const std::string &ruta, const Cabecera &c){
+		f.open(ruta.c_str(), std::ios::binary | std::ios::trunc);
+		if (!f){
+			std::cout << ruta << ": no se puede escribir" << std::endl;
+			return false;
+		}
+		std::vector<char> relleno(c.inicioAlturas - sizeof(Cabecera), 0);
+		f.write((const char*)&c, sizeof(c));
+		f.write(&relleno[0], relleno.size());
+		return true;
+	}
+
+	/**
+	* Escribe el archivo completo del mapa en ruta, sin pasar por un temporal
+	*/
+	static bool escribe(const Map &m, const std::string &ruta, Tipo tipo){
+		int size = m.size;
+		const float *map = m.map;
+		Cabecera c;
+		memset(&c, 0, sizeof(c));
+		memcpy(c.marca, "MGSH", 4);
+		c.version = VERSION;
+		c.detalle = 0;
+		while ((1 << c.detalle) + 1 < size) ++c.detalle;
+		c.semilla = m.seed;
+		c.roughness = m.roughness;
+		c.alturaMin = FLT_MAX;
+		c.alturaMax = -FLT_MAX;
+		for (int i = 0; i < size * size; ++i){
+			if (map[i] < c.alturaMin) c.alturaMin = map[i];
+			if (map[i] > c.alturaMax) c.alturaMax = map[i];
+		}
+		c.tipo = tipo;
+		c.inicioAlturas = INICIO_ALTURAS;
+
+		std::ofstream f;
+		if (!abre(f, ruta, c)){
+			return false;
+		}
+		if (tipo == FLOAT32){
+			f.write((const char*)map, (std::streamsize)size * size * sizeof(float));
+		}
+		else if (tipo == COMPRIMIDO){
+			std::vector<sf::Uint8> datos;
+			CodecAlturas::codifica(map, size, datos);
+			f.write((const char*)&datos[0], datos.size());
+		}
+		else{
+			std::vector<sf::Uint8> fila(size);
+			for (int y = 0; y < size && f; ++y){
+				for (int x = 0; x < size; ++x){
+					float h = map[x + size * y];
+					fila[x] = (sf::Uint8)((h < 0) ? 0 : (h > 255) ? 255 : h + 0.5f);
+				}
+				f.write((const char*)&fila[0], size);
+			}
+		}
+		if (!f){
+			std::cout << ruta << ": error al escribir" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Guarda m en ruta a traves de un temporal. Si proyectado no es nullptr (es el mismo m) y sus alturas estan
+	* proyectadas desde ruta, las pasa a memoria antes de reemplazar el archivo, porque el sistema no deja reemplazar un
+	* archivo proyectado
+	*/
+	static bool guarda(const Map &m, const std::string &ruta, Tipo tipo, Map *proyectado){
+		std::string temporal = ArchivoMapa::temporal(ruta);
+		if (!escribe(m, temporal, tipo)){
+			DeleteFileA(temporal.c_str());
+			return false;
+		}
+		if (proyectado != nullptr && proyectado->vista != nullptr && mismoArchivo(proyectado->archivo, ruta)){
+			proyectado->sueltaArchivo();
+		}
+		return reemplaza(temporal, ruta);
+	}
+
+public:
+
+	/**
+	* Nombre para un archivo temporal junto a ruta, distinto en cada proceso y en cada llamada, para escribir en el y
+	* renombrarlo al final
+	*/
+	static std::string temporal(const std::string &ruta){
+		static volatile LONG contador = 0;
+		std::ostringstream nombre;
+		nombre << ruta << "." << GetCurrentProcessId() << "." << InterlockedIncrement(&contador) << ".tmp";
+		return nombre.str();
+	}
+
+	/**
+	* Guarda el mapa en ruta, con las alturas en el tipo dado. Devuelve false si no se ha podido escribir.
+	* Un mapa constante no puede soltar su proyeccion, asi que no se puede guardar encima de su propio archivo
+	*/
+	static bool guarda(const Map &m, const std::string &ruta, Tipo tipo = FLOAT32){
+		return guarda(m, ruta, tipo, nullptr);
+	}
+
+	/**
+	* Como el anterior, pero si m esta proyectado desde ruta deja de estarlo (sus alturas pasan a memoria y cambian de
+	* direccion) para poder reemplazar el archivo
+	*/
+	static bool guarda(Map &m, const std::string &ruta, Tipo tipo = FLOAT32){
+		return guarda(m, ruta, tipo, &m);
+	}
+
+	/**
+	* Guarda como COMPRIMIDO unas alturas que ya vienen comprimidas con CodecAlturas::codifica (por ejemplo, las que
+	* manda un Trabajador), sin descomprimirlas. Devuelve false si no se ha podido escribir
+	*/
+	static bool guardaComprimido(const std::string &ruta, int detalle, int semilla, float roughness, float alturaMin,
+		float alturaMax, const std::string &datos){
+		Cabecera c;
+		memset(&c, 0, sizeof(c));
+		memcpy(c.marca, "MGSH", 4);
+		c.version = VERSION;
+		c.detalle = detalle;
+		c.semilla = semilla;
+		c.roughness = roughness;
+		c.alturaMin = alturaMin;
+		c.alturaMax = alturaMax;
+		c.tipo = COMPRIMIDO;
+		c.inicioAlturas = INICIO_ALTURAS;
+		std::ofstream f;
+		if (!abre(f, ruta, c)){
+			return false;
+		}
+		f.write(datos.data(), datos.size());
+		if (!f){
+			std::cout << ruta << ": error al escribir" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Lee las alturas de un archivo guardado con guarda() en destino (size x size), sin crear un Map. Si cabecera no
+	* es nullptr se copia en ella la del archivo. Devuelve false si no existe, no es valido o es de otro tamano
+	*/
+	static bool leeAlturas(const std::string &ruta, float *destino, int size, Cabecera *cabecera = nullptr){
+		std::ifstream f(ruta.c_str(), std::ios::binary);
+		if (!f){
+			return false;
+		}
+		Cabecera c;
+		if (!f.read((char*)&c, sizeof(c))){
+			std::cout << ruta << ": no es un archivo de mapa" << std::endl;
+			return false;
+		}
+		f.seekg(0, std::ios::end);
+		sf::Int64 tam = f.tellg();
+		if (compruebaCabecera(c, tam, ruta) != size){
+			return false;
+		}
+		f.seekg(c.inicioAlturas);
+		if (c.tipo == FLOAT32){
+			f.read((char*)destino, (std::streamsize)size * size * sizeof(float));
+		}
+		else if (c.tipo == COMPRIMIDO){
+			std::vector<sf::Uint8> datos((size_t)(tam - c.inicioAlturas));
+			if (f.read((char*)&datos[0], datos.size()) && (CodecAlturas::leeSize(&datos[0], datos.size()) != size ||
+				!CodecAlturas::decodifica(&datos[0], datos.size(), destino))){
+				std::cout << ruta << ": datos comprimidos incorrectos" << std::endl;
+				return false;
+			}
+		}
+		else{
+			std::vector<sf::Uint8> fila(size);
+			for (int y = 0; y < size && f; ++y){
+				f.read((char*)&fila[0], size);
+				for (int x = 0; x < size; ++x){
+					destino[x + size * y] = fila[x];
+				}
+			}
+		}
+		if (!f){
+			std::cout << ruta << ": error al leer" << std::endl;
+			return false;
+		}
+		if (cabecera != nullptr){
+			*cabecera = c;
+		}
+		return true;
+	}
+
+	/**
+	* Carga un mapa guardado con guarda(), listo para dibujar. Devuelve nullptr si no existe o no es valido.
+	* El mapa devuelto es del llamante
+	*/
+	static Map *carga(const std::string &ruta){
+		std::ifstream f(ruta.c_str(), std::ios::binary);
+		if (!f){
+			return nullptr;
+		}
+		Cabecera c;
+		if (!f.read((char*)&c, sizeof(c))){
+			std::cout << ruta << ": no es un archivo de mapa" << std::endl;
+			return nullptr;
+		}
+		f.seekg(0, std::ios::end);
+		sf::Int64 tam = f.tellg();
+		f.close();
+		int size = compruebaCabecera(c, tam, ruta);
+		if (size < 0){
+			return nullptr;
+		}
+		if (c.tipo == FLOAT32){
+			return proyecta(ruta);
+		}
+		float *alturas = new float[size * size];
+		if (!leeAlturas(ruta, alturas, size)){
+			delete[] alturas;
+			return nullptr;
+		}
+		Map *m = new Map(c.detalle, c.semilla, c.roughness, alturas);
+		terminaCarga(m, c);
+		return m;
+	}
+};
+
+#endif
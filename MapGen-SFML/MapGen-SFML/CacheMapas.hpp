@@ -0,0 +1,219 @@
+#ifndef CACHEMAPAS_HPP
+#define CACHEMAPAS_HPP
+
+#include <SFML\Graphics.hpp>
+#include <Windows.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <string.h>
+#include "Map.hpp"
+#include "ArchivoMapa.hpp"
+
+/*
+* Cache en disco de mapas generados. Cada mapa se guarda en un directorio con el formato de ArchivoMapa, en un
+* archivo cuyo nombre es un hash de los parametros que lo determinan (detalle, semilla, roughness y
+* Map::VERSION_GENERADOR): el mismo mapa siempre va al mismo archivo, y al cambiar la version del generador los
+* mapas viejos simplemente dejan de encontrarse.
+* Opcionalmente se guarda tambien el color de cada casilla (.rgba, sin sombreado) para las herramientas que solo
+* quieren la imagen.
+*
+* El directorio no puede pasar de un tamano maximo: al guardar, si se pasa, se borran los mapas que hace mas tiempo
+* que no se usan (cada vez que se usa uno se actualiza la fecha de sus archivos).
+*
+* Se usa desde Map::generate con Map::setAlmacen, o directamente con busca/guarda
+*/
+class CacheMapas : public AlmacenMapas {
+private:
+
+	std::string directorio;
+	sf::Uint64 tamMaximo;
+	bool conColores;
+
+	/**
+	* Hash FNV-1a de 64 bits de los parametros de generacion
+	*/
+	static sf::Uint64 clave(int detalle, int semilla, float roughness){
+		sf::Int32 campos[4];
+		campos[0] = Map::VERSION_GENERADOR;
+		campos[1] = detalle;
+		campos[2] = semilla;
+		memcpy(&campos[3], &roughness, 4);
+		const unsigned char *p = (const unsigned char*)campos;
+		sf::Uint64 h = 14695981039346656037ULL;
+		for (size_t i = 0; i < sizeof(campos); ++i){
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	std::string ruta(int detalle, int semilla, float roughness, const char *extension) const{
+		std::ostringstream nombre;
+		nombre << std::hex << std::setw(16) << std::setfill('0') << clave(detalle, semilla, roughness);
+		return directorio + "\\" + nombre.str() + extension;
+	}
+
+	/**
+	* Pone la fecha de modificacion del archivo a ahora, para que cuente como usado recientemente
+	*/
+	static void toca(const std::string &archivo){
+		HANDLE h = CreateFileA(archivo.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (h == INVALID_HANDLE_VALUE) return;
+		FILETIME ahora;
+		GetSystemTimeAsFileTime(&ahora);
+		SetFileTime(h, NULL, NULL, &ahora);
+		CloseHandle(h);
+	}
+
+	/**
+	* Escribe en un archivo temporal y lo renombra al final, para que otro programa que use la misma cache nunca vea
+	* un archivo a medias. El temporal es distinto en cada proceso (ArchivoMapa::temporal), asi que dos que guarden el
+	* mismo mapa a la vez no escriben en el mismo archivo
+	*/
+	static bool publica(const std::string &temporal, const std::string &destino){
+		if (!MoveFileExA(temporal.c_str(), destino.c_str(), MOVEFILE_REPLACE_EXISTING)){
+			DeleteFileA(temporal.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void guardaColores(const Map &mapa){
+		int size = mapa.getSize();
+		std::string destino = ruta(mapa.getDetalle(), mapa.getSeed(), mapa.getRoughness(), ".rgba");
+		std::string temporal = ArchivoMapa::temporal(destino);
+		std::ofstream f(temporal.c_str(), std::ios::binary | std::ios::trunc);
+		std::vector<sf::Uint8> fila(4 * size);
+		for (int y = 0; y < size && f; ++y){
+			for (int x = 0; x < size; ++x){
+				sf::Color c = mapa.colorAltura((int)mapa.map[x + size * y]);
+				fila[4 * x] = c.r;
+				fila[4 * x + 1] = c.g;
+				fila[4 * x + 2] = c.b;
+				fila[4 * x + 3] = c.a;
+			}
+			f.write((const char*)&fila[0], fila.size());
+		}
+		bool bien = !!f;
+		f.close();
+		if (!bien){
+			DeleteFileA(temporal.c_str());
+			return;
+		}
+		publica(temporal, destino);
+	}
+
+	/**
+	* Borra los mapas usados hace mas tiempo hasta que el directorio quepa en tamMaximo. Los archivos de un mismo mapa
+	* (.mgs y .rgba) se borran juntos
+	*/
+	void recorta(){
+		struct Entrada {
+			sf::Uint64 bytes;
+			sf::Uint64 fecha;	// La mas reciente de sus archivos
+			std::vector<std::string> archivos;
+		};
+		std::map<std::string, Entrada> entradas;
+		sf::Uint64 total = 0;
+		WIN32_FIND_DATAA datos;
+		HANDLE busqueda = FindFirstFileA((directorio + "\\*").c_str(), &datos);
+		if (busqueda == INVALID_HANDLE_VALUE) return;
+		do{
+			if (datos.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+			std::string nombre = datos.cFileName;
+			size_t punto = nombre.find('.');
+			Entrada &e = entradas[nombre.substr(0, punto)];
+			if (e.archivos.empty()){
+				e.bytes = 0;
+				e.fecha = 0;
+			}
+			sf::Uint64 bytes = ((sf::Uint64)datos.nFileSizeHigh << 32) | datos.nFileSizeLow;
+			sf::Uint64 fecha = ((sf::Uint64)datos.ftLastWriteTime.dwHighDateTime << 32) | datos.ftLastWriteTime.dwLowDateTime;
+			e.bytes += bytes;
+			e.fecha = (std::max)(e.fecha, fecha);
+			e.archivos.push_back(directorio + "\\" + nombre);
+			total += bytes;
+		} while (FindNextFileA(busqueda, &datos));
+		FindClose(busqueda);
+		if (total <= tamMaximo) return;
+
+		std::vector<const Entrada*> orden;
+		for (auto &e : entradas){
+			orden.push_back(&e.second);
+		}
+		std::sort(orden.begin(), orden.end(), [](const Entrada *a, const Entrada *b){
+			return a->fecha < b->fecha;
+		});
+		for (size_t i = 0; i < orden.size() && total > tamMaximo; ++i){
+			for (auto &archivo : orden[i]->archivos){
+				DeleteFileA(archivo.c_str());
+			}
+			total -= orden[i]->bytes;
+		}
+	}
+
+public:
+
+	/**
+	* Cache en el directorio dado (se crea si no existe) que ocupa como mucho tamMaximo bytes.
+	* Si conColores es true, al guardar un mapa se guarda tambien el color de sus casillas
+	*/
+	CacheMapas(const std::string &directorio, sf::Uint64 tamMaximo, bool conColores = false) :
+		directorio(directorio),
+		tamMaximo(tamMaximo),
+		conColores(conColores)
+	{
+		CreateDirectoryA(directorio.c_str(), NULL);
+	}
+
+	bool busca(int detalle, int semilla, float roughness, float *alturas, int size){
+		std::string archivo = ruta(detalle, semilla, roughness, ".mgs");
+		ArchivoMapa::Cabecera c;
+		if (!ArchivoMapa::leeAlturas(archivo, alturas, size, &c)){
+			return false;
+		}
+		// Dos parametros distintos podrian dar el mismo hash: se comprueba que es de verdad el mapa pedido
+		if ((int)c.detalle != detalle || c.semilla != semilla || c.roughness != roughness){
+			return false;
+		}
+		toca(archivo);
+		toca(ruta(detalle, semilla, roughness, ".rgba"));
+		return true;
+	}
+
+	void guarda(const Map &mapa){
+		// ArchivoMapa::guarda ya escribe en un temporal propio y lo renombra
+		if (!ArchivoMapa::guarda(mapa, ruta(mapa.getDetalle(), mapa.getSeed(), mapa.getRoughness(), ".mgs"))){
+			return;
+		}
+		if (conColores){
+			guardaColores(mapa);
+		}
+		recorta();
+	}
+
+	/**
+	* Lee los colores guardados de un mapa (RGBA, fila a fila). Devuelve false si no estan en la cache
+	*/
+	bool buscaColores(int detalle, int semilla, float roughness, std::vector<sf::Uint8> &colores){
+		int size = (1 << detalle) + 1;
+		std::string archivo = ruta(detalle, semilla, roughness, ".rgba");
+		std::ifstream f(archivo.c_str(), std::ios::binary);
+		if (!f) return false;
+		colores.resize(4 * size * size);
+		if (!f.read((char*)&colores[0], colores.size())){
+			return false;
+		}
+		toca(archivo);
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,433 @@
+#ifndef CODECALTURAS_HPP
+#define CODECALTURAS_HPP
+
+#include <SFML\Config.hpp>
+#include <vector>
+#include <math.h>
+#include <string.h>
+#include "Paralelo.hpp"
+
+/*
+* Compresion sin perdidas de mapas de alturas, pensada para el terreno que sale de Diamond-Square.
+*
+* Cada casilla se predice a partir de casillas ya decodificadas siguiendo el mismo orden que la generacion: primero
+* una rejilla gruesa y luego, mitad a mitad, los centros de cada cuadrado (media de sus cuatro esquinas, paso
+* diamond) y los puntos medios de cada lado (media de sus cuatro vecinos, paso square). En un terreno suave la
+* prediccion acierta casi siempre por poco, asi que lo que se guarda (la diferencia con la prediccion) son numeros
+* pequenos. Esas diferencias se codifican con codigos Rice, cuyo parametro se adapta segun la media de las ultimas
+* diferencias de cada nivel de la jerarquia (los niveles gruesos tienen diferencias mucho mayores que los finos).
+*
+* Las alturas se tratan como enteros: tal cual si todas lo son (los mapas generados tienen alturas enteras entre 0 y
+* 255) o, si no, pasando los bits de cada float a un entero con el mismo orden, lo que conserva el valor exacto.
+*
+* El mapa se divide en teselas de LADO_TESELA casillas que se codifican por separado, con una tabla con la posicion
+* de cada una: se puede decodificar solo una tesela (acceso aleatorio) o todas a la vez en varios hilos.
+*
+* Formato (little-endian): "MGSC", version, size, modo, ladoTesela (sf::Uint32 cada uno), numTeselas + 1
+* posiciones (sf::Uint64, relativas al inicio) y los datos de las teselas
+*/
+class CodecAlturas {
+public:
+
+	enum Modo { ENTEROS = 0, FLOTANTES = 1 };
+
+	static const sf::Uint32 VERSION = 1;
+	static const int LADO_TESELA = 256;
+
+private:
+
+	static const int TAM_CABECERA = 20;
+	static const int MAX_UNARIO = 32;
+	static const int NIVELES = 32;
+
+	class EscritorBits {
+	private:
+		std::vector<sf::Uint8> &salida;
+		sf::Uint64 acumulador;
+		int bits;
+	public:
+		EscritorBits(std::vector<sf::Uint8> &salida) : salida(salida), acumulador(0), bits(0){}
+
+		void escribe(sf::Uint64 valor, int n){
+			if (n > 32){
+				escribe(valor & 0xFFFFFFFFu, 32);
+				escribe(valor >> 32, n - 32);
+				return;
+			}
+			acumulador |= (valor & ((1ULL << n) - 1)) << bits;
+			bits += n;
+			while (bits >= 8){
+				salida.push_back((sf::Uint8)acumulador);
+				acumulador >>= 8;
+				bits -= 8;
+			}
+		}
+
+		void termina(){
+			if (bits > 0) salida.push_back((sf::Uint8)acumulador);
+			acumulador = 0;
+			bits = 0;
+		}
+	};
+
+	class LectorBits {
+	private:
+		const sf::Uint8 *datos;
+		size_t n, pos;
+		sf::Uint64 acumulador;
+		int bits;
+	public:
+		bool error;
+
+		LectorBits(const sf::Uint8 *datos, size_t n) : datos(datos), n(n), pos(0), acumulador(0), bits(0), error(false){}
+
+		sf::Uint64 lee(int cuantos){
+			if (cuantos > 32){
+				sf::Uint64 bajo = lee(32);
+				return bajo | (lee(cuantos - 32) << 32);
+			}
+			while (bits < cuantos){
+				sf::Uint64 b = 0;
+				if (pos < n) b = datos[pos++];
+				else error = true;
+				acumulador |= b << bits;
+				bits += 8;
+			}
+			sf::Uint64 v = acumulador & ((1ULL << cuantos) - 1);
+			acumulador >>= cuantos;
+			bits -= cuantos;
+			return v;
+		}
+	};
+
+	/*
+	* Estado del codigo Rice adaptativo de un nivel: suma y numero de las ultimas diferencias
+	*/
+	struct Contexto {
+		sf::Uint64 suma;
+		sf::Uint32 cuenta;
+
+		Contexto() : suma(8), cuenta(1){}
+
+		int parametro() const{
+			int k = 0;
+			while (k < 60 && ((sf::Uint64)cuenta << k) < suma) ++k;
+			return k;
+		}
+
+		void actualiza(sf::Uint64 u){
+			suma += u;
+			if (++cuenta == 64){
+				suma >>= 1;
+				cuenta >>= 1;
+			}
+		}
+	};
+
+	static sf::Uint64 zigzag(sf::Int64 v){
+		return ((sf::Uint64)v << 1) ^ (sf::Uint64)(v >> 63);
+	}
+
+	static sf::Int64 deszigzag(sf::Uint64 u){
+		return (sf::Int64)(u >> 1) ^ -(sf::Int64)(u & 1);
+	}
+
+	static void escribeRice(EscritorBits &b, Contexto &c, sf::Uint64 u){
+		int k = c.parametro();
+		sf::Uint64 q = u >> k;
+		if (q < MAX_UNARIO){
+			b.escribe((1ULL << q) - 1, (int)q + 1);	// q unos y un cero
+			b.escribe(u, k);
+		}
+		else{
+			b.escribe((1ULL << MAX_UNARIO) - 1, MAX_UNARIO);
+			b.escribe(u, 64);
+		}
+		c.actualiza(u);
+	}
+
+	static sf::Uint64 leeRice(LectorBits &b, Contexto &c){
+		int k = c.parametro();
+		int q = 0;
+		while (q < MAX_UNARIO && b.lee(1) == 1 && !b.error) ++q;
+		sf::Uint64 u;
+		if (q < MAX_UNARIO){
+			u = ((sf::Uint64)q << k) | b.lee(k);
+		}
+		else{
+			u = b.lee(64);
+		}
+		c.actualiza(u);
+		return u;
+	}
+
+	/**
+	* Entero con el mismo orden que el float (los negativos se invierten), para el modo FLOTANTES
+	*/
+	static sf::Int64 aEntero(float f){
+		sf::Uint32 b;
+		memcpy(&b, &f, 4);
+		b = (b & 0x80000000u) ? ~b : (b | 0x80000000u);
+		return (sf::Int64)b;
+	}
+
+	static float aFloat(sf::Int64 v){
+		sf::Uint32 b = (sf::Uint32)v;
+		b = (b & 0x80000000u) ? (b & 0x7FFFFFFFu) : ~b;
+		float f;
+		memcpy(&f, &b, 4);
+		return f;
+	}
+
+	/**
+	* Numero de teselas por lado y casillas de la tesela t en un eje (la ultima se queda con lo que sobra)
+	*/
+	static int teselasPorLado(int size){
+		int n = (size - 1) / LADO_TESELA;
+		return (n < 1) ? 1 : n;
+	}
+
+	static void rangoTesela(int size, int t, int &inicio, int &fin){
+		int n = teselasPorLado(size);
+		inicio = t * LADO_TESELA;
+		fin = (t == n - 1) ? size : inicio + LADO_TESELA;
+	}
+
+	/**
+	* Recorre las casillas de una tesela de ancho x alto en el orden jerarquico y llama a f(x, y, prediccion, nivel)
+	* para cada una. v son los valores de la tesela, ya conocidos para todas las casillas anteriores en el orden (f
+	* rellena la actual al codificar o decodificar)
+	*/
+	template <class F>
+	static void recorre(std::vector<sf::Int64> &v, int ancho, int alto, F f){
+		int mayor = (ancho > alto) ? ancho : alto;
+		int grueso = 1;
+		while (grueso * 2 < mayor) grueso *= 2;
+		int nivel = 0;
+		// Rejilla gruesa: cada punto se predice con el anterior de su fila (o el de arriba al principio de la fila)
+		for (int y = 0; y < alto; y += grueso){
+			for (int x = 0; x < ancho; x += grueso){
+				sf::Int64 p = (x > 0) ? v[x - grueso + ancho * y] : (y > 0) ? v[ancho * (y - grueso)] : 0;
+				f(x, y, p, nivel);
+			}
+		}
+		for (int s = grueso / 2; s >= 1; s /= 2){
+			++nivel;
+			// Diamond: centros de los cuadrados de lado 2s, con sus esquinas
+			for (int y = s; y < alto; y += 2 * s){
+				for (int x = s; x < ancho; x += 2 * s){
+					sf::Int64 suma = v[(x - s) + ancho * (y - s)];
+					int n = 1;
+					bool dcha = x + s < ancho, abajo = y + s < alto;
+					if (dcha){ suma += v[(x + s) + ancho * (y - s)]; ++n; }
+					if (abajo){ suma += v[(x - s) + ancho * (y + s)]; ++n; }
+					if (dcha && abajo){ suma += v[(x + s) + ancho * (y + s)]; ++n; }
+					f(x, y, media(suma, n), nivel);
+				}
+			}
+			++nivel;
+			// Square: puntos medios de los lados, con sus cuatro vecinos a distancia s
+			for (int y = 0; y < alto; y += s){
+				int x0 = ((y / s) % 2 == 0) ? s : 0;
+				for (int x = x0; x < ancho; x += 2 * s){
+					sf::Int64 suma = 0;
+					int n = 0;
+					if (x >= s){ suma += v[(x - s) + ancho * y]; ++n; }
+					if (x + s < ancho){ suma += v[(x + s) + ancho * y]; ++n; }
+					if (y >= s){ suma += v[x + ancho * (y - s)]; ++n; }
+					if (y + s < alto){ suma += v[x + ancho * (y + s)]; ++n; }
+					f(x, y, media(suma, n), nivel);
+				}
+			}
+		}
+	}
+
+	static sf::Int64 media(sf::Int64 suma, int n){
+		return (suma >= 0) ? (suma + n / 2) / n : -((-suma + n / 2) / n);
+	}
+
+	/**
+	* Codifica la region de ancho x alto casillas que empieza en origen, con paso casillas entre una fila y la siguiente
+	*/
+	static void codificaRegion(const float *origen, int paso, int ancho, int alto, Modo modo, std::vector<sf::Uint8> &salida){
+		std::vector<sf::Int64> v(ancho * alto);
+		for (int y = 0; y < alto; ++y){
+			for (int x = 0; x < ancho; ++x){
+				float h = origen[x + paso * y];
+				v[x + ancho * y] = (modo == ENTEROS) ? (sf::Int64)h : aEntero(h);
+			}
+		}
+		Contexto contextos[NIVELES];
+		EscritorBits b(salida);
+		recorre(v, ancho, alto, [&](int x, int y, sf::Int64 prediccion, int nivel){
+			escribeRice(b, contextos[nivel % NIVELES], zigzag(v[x + ancho * y] - prediccion));
+		});
+		b.termina();
+	}
+
+	static bool decodificaRegion(const sf::Uint8 *datos, size_t n, float *destino, int paso, int ancho, int alto, Modo modo){
+		std::vector<sf::Int64> v(ancho * alto);
+		Contexto contextos[NIVELES];
+		LectorBits b(datos, n);
+		recorre(v, ancho, alto, [&](int x, int y, sf::Int64 prediccion, int nivel){
+			v[x + ancho * y] = prediccion + deszigzag(leeRice(b, contextos[nivel % NIVELES]));
+		});
+		if (b.error) return false;
+		for (int y = 0; y < alto; ++y){
+			for (int x = 0; x < ancho; ++x){
+				sf::Int64 h = v[x + ancho * y];
+				destino[x + paso * y] = (modo == ENTEROS) ? (float)h : aFloat(h);
+			}
+		}
+		return true;
+	}
+
+	static void codificaTesela(const float *map, int size, Modo modo, int tx, int ty, std::vector<sf::Uint8> &salida){
+		int x0, x1, y0, y1;
+		rangoTesela(size, tx, x0, x1);
+		rangoTesela(size, ty, y0, y1);
+		codificaRegion(map + x0 + size * y0, size, x1 - x0, y1 - y0, modo, salida);
+	}
+
+	static bool decodificaTesela(const sf::Uint8 *datos, size_t n, int size, Modo modo, int tx, int ty, float *map){
+		int x0, x1, y0, y1;
+		rangoTesela(size, tx, x0, x1);
+		rangoTesela(size, ty, y0, y1);
+		return decodificaRegion(datos, n, map + x0 + size * y0, size, x1 - x0, y1 - y0, modo);
+	}
+
+	static Modo eligeModo(const float *origen, int paso, int ancho, int alto){
+		for (int y = 0; y < alto; ++y){
+			for (int x = 0; x < ancho; ++x){
+				float h = origen[x + paso * y];
+				if (h != floorf(h) || fabs(h) > 1e9f) return FLOTANTES;
+			}
+		}
+		return ENTEROS;
+	}
+
+	static sf::Uint32 lee32(const sf::Uint8 *p){
+		return p[0] | (p[1] << 8) | (p[2] << 16) | ((sf::Uint32)p[3] << 24);
+	}
+
+	static void escribe32(std::vector<sf::Uint8> &s, size_t pos, sf::Uint32 v){
+		for (int i = 0; i < 4; ++i) s[pos + i] = (sf::Uint8)(v >> (8 * i));
+	}
+
+	static sf::Uint64 posicionTesela(const sf::Uint8 *datos, int t){
+		const sf::Uint8 *p = datos + TAM_CABECERA + 8 * t;
+		return lee32(p) | ((sf::Uint64)lee32(p + 4) << 32);
+	}
+
+public:
+
+	/**
+	* Modo que conviene para un mapa: ENTEROS si todas las alturas son enteras (y caben de sobra en 32 bits)
+	*/
+	static Modo eligeModo(const float *map, int size){
+		return eligeModo(map, size, size, size);
+	}
+
+	/**
+	* Comprime las size x size alturas en salida (se sustituye lo que tenga). Las teselas se codifican en paralelo
+	*/
+	static void codifica(const float *map, int size, std::vector<sf::Uint8> &salida){
+		Modo modo = eligeModo(map, size);
+		int n = teselasPorLado(size);
+		std::vector<std::vector<sf::Uint8> > teselas(n * n);
+		paralelo(0, n * n, [&](int t){
+			codificaTesela(map, size, modo, t % n, t / n, teselas[t]);
+		}, 1);
+		size_t inicioDatos = TAM_CABECERA + 8 * (n * n + 1);
+		salida.assign(inicioDatos, 0);
+		memcpy(&salida[0], "MGSC", 4);
+		escribe32(salida, 4, VERSION);
+		escribe32(salida, 8, size);
+		escribe32(salida, 12, modo);
+		escribe32(salida, 16, LADO_TESELA);
+		sf::Uint64 pos = inicioDatos;
+		for (int t = 0; t <= n * n; ++t){
+			escribe32(salida, TAM_CABECERA + 8 * t, (sf::Uint32)pos);
+			escribe32(salida, TAM_CABECERA + 8 * t + 4, (sf::Uint32)(pos >> 32));
+			if (t < n * n){
+				pos += teselas[t].size();
+			}
+		}
+		for (int t = 0; t < n * n; ++t){
+			salida.insert(salida.end(), teselas[t].begin(), teselas[t].end());
+			std::vector<sf::Uint8>().swap(teselas[t]);
+		}
+	}
+
+	/**
+	* Devuelve el size del mapa comprimido en datos, o -1 si no es un mapa comprimido valido
+	*/
+	static int leeSize(const sf::Uint8 *datos, size_t n){
+		if (n < (size_t)TAM_CABECERA || memcmp(datos, "MGSC", 4) != 0 || lee32(datos + 4) != VERSION){
+			return -1;
+		}
+		int size = (int)lee32(datos + 8);
+		if (size < 2 || size > (1 << 15) + 1 || lee32(datos + 16) != (sf::Uint32)LADO_TESELA || lee32(datos + 12) > FLOTANTES){
+			return -1;
+		}
+		int teselas = teselasPorLado(size);
+		if (n < TAM_CABECERA + 8 * (size_t)(teselas * teselas + 1)){
+			return -1;
+		}
+		return size;
+	}
+
+	/**
+	* Descomprime solo la tesela (tx, ty), escribiendo sus casillas en map (size x size). Las teselas son de
+	* LADO_TESELA casillas salvo las ultimas de cada lado, que se quedan tambien con la ultima fila o columna
+	*/
+	static bool decodificaTesela(const sf::Uint8 *datos, size_t n, int tx, int ty, float *map){
+		int size = leeSize(datos, n);
+		if (size < 0) return false;
+		int lado = teselasPorLado(size);
+		if (tx < 0 || ty < 0 || tx >= lado || ty >= lado) return false;
+		int t = tx + lado * ty;
+		sf::Uint64 inicio = posicionTesela(datos, t), fin = posicionTesela(datos, t + 1);
+		if (inicio > fin || fin > n) return false;
+		Modo modo = (Modo)lee32(datos + 12);
+		return decodificaTesela(datos + inicio, (size_t)(fin - inicio), size, modo, tx, ty, map);
+	}
+
+	/**
+	* Descomprime el mapa entero en map (size x size, ver leeSize), con las teselas repartidas entre hilos
+	*/
+	static bool decodifica(const sf::Uint8 *datos, size_t n, float *map){
+		int size = leeSize(datos, n);
+		if (size < 0) return false;
+		int lado = teselasPorLado(size);
+		std::vector<char> bien(lado * lado, 0);
+		paralelo(0, lado * lado, [&](int t){
+			bien[t] = decodificaTesela(datos, n, t % lado, t / lado, map);
+		}, 1);
+		for (size_t t = 0; t < bien.size(); ++t){
+			if (!bien[t]) return false;
+		}
+		return true;
+	}
+
+	/**
+	* Comprime un rectangulo de ancho x alto alturas que empieza en origen (paso es la distancia entre filas, size para
+	* un trozo de Map::map) en salida, sin cabecera ni teselas: un byte con el modo seguido de los datos.
+	* Para guardar trozos pequenos de un mapa, como hace Historial
+	*/
+	static void codificaRectangulo(const float *origen, int paso, int ancho, int alto, std::vector<sf::Uint8> &salida){
+		Modo modo = eligeModo(origen, paso, ancho, alto);
+		salida.assign(1, (sf::Uint8)modo);
+		codificaRegion(origen, paso, ancho, alto, modo, salida);
+	}
+
+	/**
+	* Descomprime un rectangulo comprimido con codificaRectangulo en destino, que tiene que ser del mismo tamano
+	*/
+	static bool decodificaRectangulo(const sf::Uint8 *datos, size_t n, float *destino, int paso, int ancho, int alto){
+		if (n < 1 || datos[0] > FLOTANTES) return false;
+		return decodificaRegion(datos + 1, n - 1, destino, paso, ancho, alto, (Modo)datos[0]);
+	}
+};
+
+#endif
@@ -0,0 +1,694 @@
+#ifndef COMPRESION_HPP
+#define COMPRESION_HPP
+
+#include <SFML\Config.hpp>
+#include <vector>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <string.h>
+
+/*
+* Compresor en formato zlib (deflate, RFC 1950/1951), el que usan los PNG. Esta hecho aqui para no depender de zlib.
+*
+* Funciona por partes: se le van dando datos con comprime() y, cada vez que junta BLOQUE bytes, los comprime y deja
+* el resultado en getSalida(), que el llamante vacia cuando quiera. Solo guarda los ultimos 32 KB ya comprimidos
+* (lo que deflate permite referenciar) y el bloque en curso, asi que la memoria no depende del tamano total.
+*
+* Las repeticiones se buscan con una tabla hash de 3 bytes que guarda la ultima posicion de cada hash (sin cadenas):
+* es rapido y en datos de terreno filtrados encuentra casi todo lo que hay. Cada bloque se codifica con codigos
+* Huffman calculados para ese bloque.
+* Para leer se usa Descompresor
+*/
+class Compresor {
+	friend class Descompresor;
+
+public:
+
+	static const int BLOQUE = 1 << 16;
+
+private:
+
+	static const int VENTANA = 1 << 15;
+	static const int MIN_REPETICION = 3;
+	static const int MAX_REPETICION = 258;
+	static const int BITS_HASH = 15;
+
+	/*
+	* Simbolo de un bloque: un byte suelto (longitud 0, el byte en distancia) o una repeticion
+	*/
+	struct Simbolo {
+		sf::Uint16 longitud;
+		sf::Uint16 distancia;
+	};
+
+	std::vector<sf::Uint8> datos;	// Ultimos VENTANA bytes ya comprimidos y los que faltan por comprimir
+	size_t hecho;					// Posicion en datos del primer byte sin comprimir
+	sf::Uint64 inicio;				// Posicion absoluta de datos[0]
+	std::vector<sf::Uint64> cabeza;	// Ultima posicion absoluta + 1 de cada hash (0 si ninguna)
+	std::vector<Simbolo> simbolos;
+	sf::Uint32 adlerA, adlerB;
+
+	std::vector<sf::Uint8> salida;
+	sf::Uint32 acumulador;
+	int bitsAcumulados;
+
+	static const sf::Uint16 *baseLongitud(){
+		static const sf::Uint16 t[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+			99, 115, 131, 163, 195, 227, 258 };
+		return t;
+	}
+	static const sf::Uint8 *extraLongitud(){
+		static const sf::Uint8 t[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		return t;
+	}
+	static const sf::Uint16 *baseDistancia(){
+		static const sf::Uint16 t[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+			1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		return t;
+	}
+	static const sf::Uint8 *extraDistancia(){
+		static const sf::Uint8 t[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+			12, 12, 13, 13 };
+		return t;
+	}
+
+	static int codigoLongitud(int longitud){
+		int c = 0;
+		while (c < 28 && baseLongitud()[c + 1] <= longitud) ++c;
+		return c;
+	}
+
+	static int codigoDistancia(int distancia){
+		int c = 0;
+		while (c < 29 && baseDistancia()[c + 1] <= distancia) ++c;
+		return c;
+	}
+
+	void escribeBits(sf::Uint32 valor, int n){
+		acumulador |= valor << bitsAcumulados;
+		bitsAcumulados += n;
+		while (bitsAcumulados >= 8){
+			salida.push_back((sf::Uint8)acumulador);
+			acumulador >>= 8;
+			bitsAcumulados -= 8;
+		}
+	}
+
+	/**
+	* Los codigos Huffman se escriben empezando por el bit mas significativo
+	*/
+	void escribeCodigo(sf::Uint32 codigo, int longitud){
+		sf::Uint32 invertido = 0;
+		for (int i = 0; i < longitud; ++i){
+			invertido = (invertido << 1) | ((codigo >> i) & 1);
+		}
+		escribeBits(invertido, longitud);
+	}
+
+	/**
+	* Calcula las longitudes de un codigo Huffman para las frecuencias dadas, sin pasar de maxBits. Si el arbol sale
+	* mas profundo se aplanan las frecuencias (se dividen entre 2) y se vuelve a construir
+	*/
+	static void longitudes(std::vector<sf::Uint32> frec, int maxBits, std::vector<sf::Uint8> &lon){
+		size_t n = frec.size();
+		lon.assign(n, 0);
+		int usados = 0;
+		size_t unico = 0;
+		for (size_t i = 0; i < n; ++i){
+			if (frec[i] > 0){
+				++usados;
+				unico = i;
+			}
+		}
+		if (usados == 0) return;
+		if (usados == 1){
+			lon[unico] = 1;
+			return;
+		}
+		for (;;){
+			typedef std::pair<sf::Uint64, int> Nodo;
+			std::priority_queue<Nodo, std::vector<Nodo>, std::greater<Nodo> > cola;
+			std::vector<int> padre(2 * n, -1);
+			for (size_t i = 0; i < n; ++i){
+				if (frec[i] > 0) cola.push(Nodo(frec[i], (int)i));
+			}
+			int siguiente = (int)n;
+			while (cola.size() > 1){
+				Nodo a = cola.top(); cola.pop();
+				Nodo b = cola.top(); cola.pop();
+				padre[a.second] = siguiente;
+				padre[b.second] = siguiente;
+				cola.push(Nodo(a.first + b.first, siguiente));
+				++siguiente;
+			}
+			int maxima = 0;
+			for (size_t i = 0; i < n; ++i){
+				if (frec[i] == 0) continue;
+				int d = 0;
+				for (int p = padre[i]; p != -1; p = padre[p]) ++d;
+				lon[i] = (sf::Uint8)d;
+				if (d > maxima) maxima = d;
+			}
+			if (maxima <= maxBits) return;
+			for (size_t i = 0; i < n; ++i){
+				if (frec[i] > 0) frec[i] = (frec[i] >> 1) | 1;
+			}
+		}
+	}
+
+	/**
+	* Codigos canonicos a partir de las longitudes (RFC 1951, 3.2.2)
+	*/
+	static void codigos(const std::vector<sf::Uint8> &lon, std::vector<sf::Uint16> &cod){
+		int cuenta[16] = { 0 };
+		for (size_t i = 0; i < lon.size(); ++i) cuenta[lon[i]]++;
+		cuenta[0] = 0;
+		int siguiente[16];
+		int c = 0;
+		for (int b = 1; b < 16; ++b){
+			c = (c + cuenta[b - 1]) << 1;
+			siguiente[b] = c;
+		}
+		cod.assign(lon.size(), 0);
+		for (size_t i = 0; i < lon.size(); ++i){
+			if (lon[i] > 0) cod[i] = (sf::Uint16)siguiente[lon[i]]++;
+		}
+	}
+
+	/**
+	* Escribe los simbolos acumulados como un bloque deflate con codigos Huffman propios
+	*/
+	void escribeBloque(bool final){
+		std::vector<sf::Uint32> frecLit(286, 0), frecDist(30, 0);
+		for (size_t i = 0; i < simbolos.size(); ++i){
+			const Simbolo &s = simbolos[i];
+			if (s.longitud == 0){
+				frecLit[s.distancia]++;
+			}
+			else{
+				frecLit[257 + codigoLongitud(s.longitud)]++;
+				frecDist[codigoDistancia(s.distancia)]++;
+			}
+		}
+		frecLit[256] = 1;
+		std::vector<sf::Uint8> lonLit, lonDist;
+		longitudes(frecLit, 15, lonLit);
+		longitudes(frecDist, 15, lonDist);
+		if (std::count(lonDist.begin(), lonDist.end(), 0) == (int)lonDist.size()){
+			// Siempre tiene que haber al menos un codigo de distancia
+			lonDist[0] = 1;
+		}
+		int hlit = 286, hdist = 30;
+		while (hlit > 257 && lonLit[hlit - 1] == 0) --hlit;
+		while (hdist > 1 && lonDist[hdist - 1] == 0) --hdist;
+
+		// Longitudes de los dos codigos seguidas, comprimidas con los simbolos 16 (repetir), 17 y 18 (ceros)
+		std::vector<sf::Uint8> todas(lonLit.begin(), lonLit.begin() + hlit);
+		todas.insert(todas.end(), lonDist.begin(), lonDist.begin() + hdist);
+		std::vector<sf::Uint8> rle, extra;
+		for (size_t i = 0; i < todas.size();){
+			size_t j = i;
+			while (j < todas.size() && todas[j] == todas[i]) ++j;
+			int repes = (int)(j - i);
+			if (todas[i] == 0){
+				while (repes >= 11){ int r = (repes > 138) ? 138 : repes; rle.push_back(18); extra.push_back((sf::Uint8)(r - 11)); repes -= r; }
+				if (repes >= 3){ rle.push_back(17); extra.push_back((sf::Uint8)(repes - 3)); repes = 0; }
+				while (repes-- > 0){ rle.push_back(0); extra.push_back(0); }
+			}
+			else{
+				rle.push_back(todas[i]); extra.push_back(0);
+				--repes;
+				while (repes >= 3){ int r = (repes > 6) ? 6 : repes; rle.push_back(16); extra.push_back((sf::Uint8)(r - 3)); repes -= r; }
+				while (repes-- > 0){ rle.push_back(todas[i]); extra.push_back(0); }
+			}
+			i = j;
+		}
+		std::vector<sf::Uint32> frecLon(19, 0);
+		for (size_t i = 0; i < rle.size(); ++i) frecLon[rle[i]]++;
+		std::vector<sf::Uint8> lonLon;
+		longitudes(frecLon, 7, lonLon);
+		static const int orden[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		int hclen = 19;
+		while (hclen > 4 && lonLon[orden[hclen - 1]] == 0) --hclen;
+
+		std::vector<sf::Uint16> codLit, codDist, codLon;
+		codigos(lonLit, codLit);
+		codigos(lonDist, codDist);
+		codigos(lonLon, codLon);
+
+		escribeBits(final ? 1 : 0, 1);
+		escribeBits(2, 2);
+		escribeBits(hlit - 257, 5);
+		escribeBits(hdist - 1, 5);
+		escribeBits(hclen - 4, 4);
+		for (int i = 0; i < hclen; ++i){
+			escribeBits(lonLon[orden[i]], 3);
+		}
+		static const int bitsExtra[3] = { 2, 3, 7 };
+		for (size_t i = 0; i < rle.size(); ++i){
+			escribeCodigo(codLon[rle[i]], lonLon[rle[i]]);
+			if (rle[i] >= 16) escribeBits(extra[i], bitsExtra[rle[i] - 16]);
+		}
+		for (size_t i = 0; i < simbolos.size(); ++i){
+			const Simbolo &s = simbolos[i];
+			if (s.longitud == 0){
+				escribeCodigo(codLit[s.distancia], lonLit[s.distancia]);
+			}
+			else{
+				int cl = codigoLongitud(s.longitud);
+				escribeCodigo(codLit[257 + cl], lonLit[257 + cl]);
+				escribeBits(s.longitud - baseLongitud()[cl], extraLongitud()[cl]);
+				int cd = codigoDistancia(s.distancia);
+				escribeCodigo(codDist[cd], lonDist[cd]);
+				escribeBits(s.distancia - baseDistancia()[cd], extraDistancia()[cd]);
+			}
+		}
+		escribeCodigo(codLit[256], lonLit[256]);
+		simbolos.clear();
+	}
+
+	static sf::Uint32 hash(const sf::Uint8 *p){
+		return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & ((1 << BITS_HASH) - 1);
+	}
+
+	/**
+	* Busca repeticiones en los datos pendientes hasta limite (posicion en datos) y los pasa a simbolos
+	*/
+	void procesa(size_t limite){
+		size_t fin = datos.size();
+		size_t i = hecho;
+		while (i < limite){
+			int mejor = 0;
+			sf::Uint32 distancia = 0;
+			if (i + MIN_REPETICION <= fin){
+				sf::Uint32 h = hash(&datos[i]);
+				sf::Uint64 absoluta = inicio + i;
+				sf::Uint64 previa = cabeza[h];
+				cabeza[h] = absoluta + 1;
+				if (previa != 0 && previa - 1 >= inicio && absoluta - (previa - 1) <= VENTANA){
+					size_t j = (size_t)(previa - 1 - inicio);
+					size_t maximo = fin - i;
+					if (maximo > MAX_REPETICION) maximo = MAX_REPETICION;
+					int l = 0;
+					while ((size_t)l < maximo && datos[j + l] == datos[i + l]) ++l;
+					if (l >= MIN_REPETICION){
+						mejor = l;
+						distancia = (sf::Uint32)(absoluta - (previa - 1));
+					}
+				}
+			}
+			if (mejor > 0){
+				Simbolo s = { (sf::Uint16)mejor, (sf::Uint16)distancia };
+				simbolos.push_back(s);
+				for (int k = 1; k < mejor && i + k + MIN_REPETICION <= fin; ++k){
+					cabeza[hash(&datos[i + k])] = inicio + i + k + 1;
+				}
+				i += mejor;
+			}
+			else{
+				Simbolo s = { 0, datos[i] };
+				simbolos.push_back(s);
+				++i;
+			}
+		}
+		hecho = i;
+		// Se descarta lo que ya no se puede referenciar
+		if (hecho > 2 * VENTANA){
+			size_t quita = hecho - VENTANA;
+			datos.erase(datos.begin(), datos.begin() + quita);
+			inicio += quita;
+			hecho -= quita;
+		}
+	}
+
+public:
+
+	Compresor() :
+		hecho(0),
+		inicio(0),
+		cabeza(1 << BITS_HASH, 0),
+		adlerA(1),
+		adlerB(0),
+		acumulador(0),
+		bitsAcumulados(0)
+	{
+		// Cabecera zlib: deflate con ventana de 32 KB
+		salida.push_back(0x78);
+		salida.push_back(0x01);
+	}
+
+	void comprime(const sf::Uint8 *p, size_t n){
+		for (size_t i = 0; i < n; ++i){
+			adlerA = (adlerA + p[i]) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+		datos.insert(datos.end(), p, p + n);
+		// Se deja sin procesar el final, por si una repeticion sigue en los datos que aun no han llegado
+		while (datos.size() - hecho >= (size_t)(BLOQUE + MAX_REPETICION)){
+			procesa(hecho + BLOQUE);
+			escribeBloque(false);
+		}
+	}
+
+	/**
+	* Comprime lo que quede y cierra el flujo. Despues no se puede llamar a comprime
+	*/
+	void termina(){
+		procesa(datos.size());
+		escribeBloque(true);
+		if (bitsAcumulados > 0){
+			salida.push_back((sf::Uint8)acumulador);
+			acumulador = 0;
+			bitsAcumulados = 0;
+		}
+		salida.push_back((sf::Uint8)(adlerB >> 8));
+		salida.push_back((sf::Uint8)adlerB);
+		salida.push_back((sf::Uint8)(adlerA >> 8));
+		salida.push_back((sf::Uint8)adlerA);
+	}
+
+	/**
+	* Bytes comprimidos hasta ahora. El llamante los escribe donde quiera y vacia el vector
+	*/
+	std::vector<sf::Uint8> &getSalida(){
+		return salida;
+	}
+};
+
+/*
+* Descompresor de flujos zlib, para leer PNG (ver LectorPng). Funciona a demanda: pide los bytes comprimidos a una
+* fuente segun le hacen falta y entrega los descomprimidos en los trozos que pida el llamante, asi que solo guarda los
+* ultimos 32 KB descomprimidos (la ventana de deflate) y un bufer de entrada.
+* Cada codigo Huffman se decodifica con una tabla indexada por los siguientes bits, de un solo acceso
+*/
+class Descompresor {
+public:
+
+	/* Copia hasta n bytes comprimidos en p y devuelve cuantos ha copiado (0 si no hay mas) */
+	typedef std::function<size_t(sf::Uint8 *p, size_t n)> Fuente;
+
+private:
+
+	static const int VENTANA = 1 << 15;
+	static const int TAM_ENTRADA = 1 << 14;
+
+	enum Estado { CABECERA, BLOQUE, ALMACENADO, HUFFMAN, FIN, ERROR };
+
+	/*
+	* Tabla de un codigo Huffman: con los siguientes bits del flujo (el primero en el bit bajo) da simbolo << 4 | longitud,
+	* o 0 si no hay ningun codigo con esos bits
+	*/
+	struct Tabla {
+		std::vector<sf::Uint16> entradas;
+		int bits;
+	};
+
+	Fuente fuente;
+	std::vector<sf::Uint8> entrada;
+	size_t posEntrada, finEntrada;
+	sf::Uint64 acumulador;
+	int bits;
+	int relleno;					// Bytes a cero anadidos al acumulador despues del final de la fuente
+
+	std::vector<sf::Uint8> ventana;
+	sf::Uint64 total;				// Bytes descomprimidos hasta ahora
+	Estado estado;
+	bool ultimo;					// El bloque en curso es el ultimo
+	size_t pendiente;				// Bytes que faltan de un bloque sin comprimir o de una repeticion
+	int distancia;
+	Tabla literales, distancias;
+	sf::Uint32 adlerA, adlerB;
+
+	void asegura(int n){
+		while (bits < n){
+			if (posEntrada == finEntrada){
+				finEntrada = fuente(&entrada[0], entrada.size());
+				posEntrada = 0;
+			}
+			sf::Uint64 b = 0;
+			if (posEntrada < finEntrada){
+				b = entrada[posEntrada++];
+			}
+			else{
+				++relleno;
+			}
+			acumulador |= b << bits;
+			bits += 8;
+		}
+	}
+
+	void consume(int n){
+		acumulador >>= n;
+		bits -= n;
+		if (bits < 8 * relleno){
+			estado = ERROR;	// Se ha leido mas alla del final
+		}
+	}
+
+	sf::Uint32 lee(int n){
+		if (n == 0) return 0;
+		asegura(n);
+		sf::Uint32 v = (sf::Uint32)(acumulador & ((1ULL << n) - 1));
+		consume(n);
+		return v;
+	}
+
+	int decodifica(const Tabla &t){
+		asegura(t.bits);
+		sf::Uint16 e = t.entradas[(size_t)(acumulador & ((1ULL << t.bits) - 1))];
+		if ((e & 15) == 0){
+			estado = ERROR;
+			return 0;
+		}
+		consume(e & 15);
+		return e >> 4;
+	}
+
+	/**
+	* Tabla de decodificacion de un codigo dado por las longitudes de sus simbolos. Devuelve false si las longitudes
+	* no forman un codigo valido
+	*/
+	static bool construye(const std::vector<sf::Uint8> &lon, Tabla &t){
+		t.bits = 1;
+		sf::Uint32 kraft = 0;
+		for (size_t i = 0; i < lon.size(); ++i){
+			if (lon[i] > t.bits) t.bits = lon[i];
+			if (lon[i] > 0) kraft += 1u << (15 - lon[i]);
+		}
+		if (kraft > (1u << 15)) return false;
+		std::vector<sf::Uint16> cod;
+		Compresor::codigos(lon, cod);
+		t.entradas.assign((size_t)1 << t.bits, 0);
+		for (size_t s = 0; s < lon.size(); ++s){
+			int l = lon[s];
+			if (l == 0) continue;
+			int invertido = 0;
+			for (int b = 0; b < l; ++b){
+				invertido |= ((cod[s] >> b) & 1) << (l - 1 - b);
+			}
+			for (size_t k = invertido; k < t.entradas.size(); k += (size_t)1 << l){
+				t.entradas[k] = (sf::Uint16)((s << 4) | l);
+			}
+		}
+		return true;
+	}
+
+	bool leeCodigosFijos(){
+		std::vector<sf::Uint8> lon(288, 8);
+		std::fill(lon.begin() + 144, lon.begin() + 256, 9);
+		std::fill(lon.begin() + 256, lon.begin() + 280, 7);
+		std::vector<sf::Uint8> dist(30, 5);
+		return construye(lon, literales) && construye(dist, distancias);
+	}
+
+	bool leeCodigosDinamicos(){
+		static const int orden[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+		int nLit = lee(5) + 257, nDist = lee(5) + 1, nLon = lee(4) + 4;
+		std::vector<sf::Uint8> lonLon(19, 0);
+		for (int i = 0; i < nLon; ++i){
+			lonLon[orden[i]] = (sf::Uint8)lee(3);
+		}
+		Tabla tablaLon;
+		if (!construye(lonLon, tablaLon)) return false;
+		std::vector<sf::Uint8> lon;
+		while ((int)lon.size() < nLit + nDist && estado != ERROR){
+			int s = decodifica(tablaLon);
+			if (s < 16){
+				lon.push_back((sf::Uint8)s);
+				continue;
+			}
+			int repite;
+			sf::Uint8 valor = 0;
+			if (s == 16){
+				if (lon.empty()) return false;
+				valor = lon.back();
+				repite = 3 + lee(2);
+			}
+			else if (s == 17){
+				repite = 3 + lee(3);
+			}
+			else{
+				repite = 11 + lee(7);
+			}
+			lon.insert(lon.end(), repite, valor);
+		}
+		if (estado == ERROR || (int)lon.size() != nLit + nDist || lon[256] == 0) return false;
+		std::vector<sf::Uint8> lit(lon.begin(), lon.begin() + nLit), dist(lon.begin() + nLit, lon.end());
+		return construye(lit, literales) && construye(dist, distancias);
+	}
+
+	void actualizaAdler(const sf::Uint8 *p, size_t n){
+		while (n > 0){
+			size_t trozo = (n < 5552) ? n : 5552;	// Lo maximo que se puede sumar sin desbordar antes del modulo
+			for (size_t i = 0; i < trozo; ++i){
+				adlerA += p[i];
+				adlerB += adlerA;
+			}
+			adlerA %= 65521;
+			adlerB %= 65521;
+			p += trozo;
+			n -= trozo;
+		}
+	}
+
+	void leeBloque(){
+		if (ultimo){
+			consume(bits & 7);
+			sf::Uint32 adler = 0;
+			for (int i = 0; i < 4; ++i){
+				adler = (adler << 8) | lee(8);
+			}
+			if (estado != ERROR){
+				estado = (adler == ((adlerB << 16) | adlerA)) ? FIN : ERROR;
+			}
+			return;
+		}
+		ultimo = lee(1) == 1;
+		int tipo = lee(2);
+		if (tipo == 0){
+			consume(bits & 7);
+			sf::Uint32 n = lee(16), complemento = lee(16);
+			if (estado == ERROR) return;
+			if ((n ^ 0xFFFF) != complemento){
+				estado = ERROR;
+				return;
+			}
+			pendiente = n;
+			estado = ALMACENADO;
+		}
+		else if (estado != ERROR){
+			bool bien = (tipo == 1) ? leeCodigosFijos() : (tipo == 2) ? leeCodigosDinamicos() : false;
+			if (!bien || estado == ERROR){
+				estado = ERROR;
+				return;
+			}
+			pendiente = 0;
+			estado = HUFFMAN;
+		}
+	}
+
+public:
+
+	Descompresor(Fuente fuente) :
+		fuente(fuente),
+		entrada(TAM_ENTRADA),
+		posEntrada(0),
+		finEntrada(0),
+		acumulador(0),
+		bits(0),
+		relleno(0),
+		ventana(VENTANA),
+		total(0),
+		estado(CABECERA),
+		ultimo(false),
+		pendiente(0),
+		distancia(0),
+		adlerA(1),
+		adlerB(0)
+	{
+	}
+
+	/**
+	* Deja en salida los siguientes n bytes descomprimidos y devuelve cuantos ha dejado: menos de n solo si se ha
+	* terminado el flujo o hay un error
+	*/
+	size_t descomprime(sf::Uint8 *salida, size_t n){
+		size_t hecho = 0, inicio = 0;
+		while (hecho < n && estado != FIN && estado != ERROR){
+			switch (estado){
+			case CABECERA:
+			{
+				int cmf = lee(8), flg = lee(8);
+				estado = ((cmf & 15) == 8 && (cmf * 256 + flg) % 31 == 0 && !(flg & 32)) ? BLOQUE : ERROR;
+				break;
+			}
+			case BLOQUE:
+				actualizaAdler(salida + inicio, hecho - inicio);
+				inicio = hecho;
+				leeBloque();
+				break;
+			case ALMACENADO:
+				if (pendiente == 0){
+					estado = BLOQUE;
+					break;
+				}
+				salida[hecho] = (sf::Uint8)lee(8);
+				ventana[total++ & (VENTANA - 1)] = salida[hecho++];
+				--pendiente;
+				break;
+			case HUFFMAN:
+			{
+				if (pendiente > 0){
+					salida[hecho] = ventana[(total - distancia) & (VENTANA - 1)];
+					ventana[total++ & (VENTANA - 1)] = salida[hecho++];
+					--pendiente;
+					break;
+				}
+				int s = decodifica(literales);
+				if (s < 256){
+					salida[hecho] = (sf::Uint8)s;
+					ventana[total++ & (VENTANA - 1)] = salida[hecho++];
+				}
+				else if (s == 256){
+					estado = BLOQUE;
+				}
+				else if (s <= 285){
+					s -= 257;
+					pendiente = Compresor::baseLongitud()[s] + lee(Compresor::extraLongitud()[s]);
+					int d = decodifica(distancias);
+					if (d >= 30){
+						estado = ERROR;
+						break;
+					}
+					distancia = Compresor::baseDistancia()[d] + lee(Compresor::extraDistancia()[d]);
+					if ((sf::Uint64)distancia > total){
+						estado = ERROR;
+					}
+				}
+				else{
+					estado = ERROR;
+				}
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		actualizaAdler(salida + inicio, hecho - inicio);
+		return hecho;
+	}
+
+	/**
+	* El flujo esta mal formado, esta truncado o no cuadra su suma de comprobacion
+	*/
+	bool error() const{
+		return estado == ERROR;
+	}
+
+	bool terminado() const{
+		return estado == FIN;
+	}
+};
+
+#endif
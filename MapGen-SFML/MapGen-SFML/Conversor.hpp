@@ -2,7 +2,11 @@
 #define CONVERSOR_HPP
 
 #include <SFML\Graphics.hpp>
+#include <vector>
+#include <algorithm>
+#include <climits>
 #include "Map.hpp"
+#include "Paralelo.hpp"
 
 class Conversor {
 private:
@@ -12,6 +16,180 @@ private:
 	int alturaAgua;
 	float higher, lower;
 
+	/*
+	* paleta[alto] es calculaColor(alto) para cada alto entre 0 y altoMapa, para no repetir la cadena de ifs por
+	* cada casilla
+	*/
+	std::vector<sf::Color> paleta;
+
+	void calculaPaleta(){
+		paleta.resize(altoMapa + 1);
+		for (int alto = 0; alto <= altoMapa; ++alto){
+			paleta[alto] = calculaColor(alto);
+		}
+	}
+
+	/**
+	* Color de la paleta para un alto, ajustado al rango por si el redondeo lo saca por algun extremo
+	*/
+	const sf::Color &colorPaleta(int alto) const{
+		return paleta[(alto < 0) ? 0 : (alto > altoMapa) ? altoMapa : alto];
+	}
+
+	/*
+	* Alto (ya recortado al nivel del agua) y color de cada casilla tal y como salen en los cortes 3D.
+	* Se calculan en una sola pasada la primera vez que se piden (preparaCasillas) y los usan todas las vistas
+	*/
+	std::vector<int> altos;
+	std::vector<sf::Color> colores;
+
+	void preparaCasillas(){
+		if (!altos.empty()) return;
+		std::vector<sf::Color> paletaAgua(altoMapa + 1);
+		for (int alto = alturaAgua + 1; alto <= altoMapa; ++alto){
+			paletaAgua[alto] = calculaColorAgua(alto);
+		}
+		altos.resize(size * size);
+		colores.resize(size * size);
+		paralelo(0, size, [&](int y){
+			int fin = size * (y + 1);
+			for (int k = size * y; k < fin; ++k){
+				int alto = calculaAlto(map[k]);
+				if (alto > alturaAgua){
+					colores[k] = paletaAgua[(alto > altoMapa) ? altoMapa : alto];
+					altos[k] = alturaAgua;
+				}
+				else{
+					colores[k] = colorPaleta(alto);
+					altos[k] = alto;
+				}
+			}
+		});
+	}
+
+	/*
+	* Desde donde se mira en los cortes 3D: cada fila se desplaza una posicion hacia abajo y, segun la direccion,
+	* tambien hacia la derecha (IZQ_DCHA), hacia la izquierda (DCHA_IZQ) o nada (FRENTE)
+	*/
+	enum Direccion { IZQ_DCHA, DCHA_IZQ, FRENTE };
+
+	/*
+	* Horizonte por columna de pantalla de los cortes rellenos, uno por direccion para que se puedan generar
+	* direcciones distintas a la vez. Se guardan para no reservarlos en cada llamada
+	*/
+	std::vector<int> horizontes[3];
+
+	/**
+	* Desplazamiento horizontal de la fila y en la direccion D. Al ser D constante se queda en una suma
+	*/
+	template <Direccion D>
+	int desplazamiento(int y) const{
+		return (D == IZQ_DCHA) ? y : (D == DCHA_IZQ) ? size - y : 0;
+	}
+
+	/**
+	* Escribe en salida los puntos de la fila y de un corte a puntos: el de arriba de cada columna de pixel.
+	* salida ya tiene que tener sitio para todo el corte; cada fila escribe en su parte, asi que se pueden rellenar
+	* varias a la vez
+	*/
+	template <Direccion D>
+	void puntosFila(sf::Vertex *salida, int pixelWidth, int y) const{
+		int dx = desplazamiento<D>(y);
+		for (int x = 0; x < size; ++x){
+			int k = x + size * y;
+			float arriba = (float)(altos[k] + y);
+			const sf::Color &color = colores[k];
+			sf::Vertex *v = salida + k * pixelWidth;
+			for (int j = 0; j < pixelWidth; ++j){
+				v[j].position = sf::Vector2f((float)(x * pixelWidth + j + dx), arriba);
+				v[j].color = color;
+			}
+		}
+	}
+
+	/**
+	* Escribe en salida un corte relleno, solo con lo que se llega a ver de cada linea.
+	* Cada fila se dibuja una posicion mas abajo que la anterior y sus lineas llegan siempre hasta altoMapa, asi que
+	* tapan todo lo que tengan detras por debajo de su alto. Se recorren las filas de la mas cercana (la ultima) a la
+	* mas lejana guardando, por cada columna de pantalla, el punto mas alto ya cubierto (horizonte): de cada linea solo
+	* se emite el tramo que queda por encima. Al final se da la vuelta a los vertices para que se dibujen de atras hacia
+	* delante y el pixel de union quede del lado de la fila cercana
+	*/
+	template <Direccion D>
+	void lineasVisibles(std::vector<sf::Vertex> &salida, int pixelWidth){
+		std::vector<int> &horizonte = horizontes[D];
+		horizonte.assign(size * pixelWidth + size + 1, INT_MAX);
+		salida.clear();
+		for (int y = size - 1; y >= 0; --y){
+			int dx = desplazamiento<D>(y);
+			int abajo = altoMapa + y;
+			for (int x = 0; x < size; ++x){
+				int k = x + size * y;
+				int arriba = altos[k] + y;
+				for (int j = 0; j < pixelWidth; ++j){
+					int px = x * pixelWidth + j + dx;
+					int &h = horizonte[px];
+					if (arriba >= h) continue;
+					int fin = (abajo < h) ? abajo : h;
+					salida.push_back(sf::Vertex(sf::Vector2f((float)px, (float)arriba), colores[k]));
+					salida.push_back(sf::Vertex(sf::Vector2f((float)px, (float)fin), colores[k]));
+					h = arriba;
+				}
+			}
+		}
+		std::reverse(salida.begin(), salida.end());
+	}
+
+	/**
+	* Genera en salida el corte en la direccion D, relleno (Puntos false) o a puntos. Direccion y relleno se fijan al
+	* compilar, asi que cada combinacion tiene su propio bucle sin comprobaciones dentro.
+	* salida es del llamante: si se usa el mismo vector en cada refresco solo reserva memoria la primera vez.
+	* Las vistas a puntos se rellenan por filas en paralelo si enParalelo es true
+	*/
+	template <Direccion D, bool Puntos>
+	void corte(std::vector<sf::Vertex> &salida, int pixelWidth, bool enParalelo){
+		if (!Puntos){
+			lineasVisibles<D>(salida, pixelWidth);
+			return;
+		}
+		salida.resize(size * size * pixelWidth);
+		sf::Vertex *v = &salida[0];
+		if (enParalelo){
+			paralelo(0, size, [&](int y){
+				puntosFila<D>(v, pixelWidth, y);
+			});
+		}
+		else{
+			for (int y = 0; y < size; ++y){
+				puntosFila<D>(v, pixelWidth, y);
+			}
+		}
+	}
+
+	typedef void (Conversor::*Nucleo)(std::vector<sf::Vertex>&, int, bool);
+
+	/**
+	* Version de corte para la vista numero v (el bit de Vista que ocupa)
+	*/
+	static Nucleo nucleo(int v){
+		static const Nucleo nucleos[6] = {
+			&Conversor::corte<IZQ_DCHA, false>, &Conversor::corte<DCHA_IZQ, false>, &Conversor::corte<FRENTE, false>,
+			&Conversor::corte<IZQ_DCHA, true>, &Conversor::corte<DCHA_IZQ, true>, &Conversor::corte<FRENTE, true>
+		};
+		return nucleos[v];
+	}
+
+	/**
+	* Copia unos vertices a un VertexArray, para los metodos que devuelven uno
+	*/
+	static sf::VertexArray aVertexArray(const std::vector<sf::Vertex> &vertices, sf::PrimitiveType tipo){
+		sf::VertexArray ret(tipo, vertices.size());
+		for (size_t i = 0; i < vertices.size(); ++i){
+			ret[i] = vertices[i];
+		}
+		return ret;
+	}
+
 	/**
 	* Devuelve el valor mas alto del mapa
 	*/
@@ -172,12 +350,192 @@ public:
 		map = mapa.map;
 		higher = findHigher();
 		lower = findLower();
+		calculaPaleta();
+	};
+
+	/*
+	* Vistas que se pueden pedir a getCortes, combinables con |
+	*/
+	enum Vista {
+		LR = 1, RL = 2, FRONT = 4,
+		LR_PUNTOS = 8, RL_PUNTOS = 16, FRONT_PUNTOS = 32,
+		TODAS = 63
+	};
+
+	/*
+	* Vertices de cada vista para getCortes. Las vistas que no se piden no se tocan, y si se reutiliza el mismo
+	* Cortes en cada refresco los vectores conservan su memoria
+	*/
+	struct Cortes {
+		std::vector<sf::Vertex> lr, rl, front;
+		std::vector<sf::Vertex> lrPuntos, rlPuntos, frontPuntos;
+	};
+
+	/**
+	* Primitiva con la que se dibujan los vertices de una vista: Lines las rellenas y Points las de puntos
+	*/
+	static sf::PrimitiveType getPrimitiva(Vista vista){
+		return (vista >= LR_PUNTOS) ? sf::PrimitiveType::Points : sf::PrimitiveType::Lines;
+	}
+
+	/**
+	* Genera una sola vista en salida, reutilizando la memoria que ya tenga. Se dibuja con
+	* target.draw(&salida[0], salida.size(), getPrimitiva(vista))
+	*/
+	void getCorte3D(std::vector<sf::Vertex> &salida, Vista vista, int pixelWidth, bool enParalelo = true){
+		preparaCasillas();
+		for (int v = 0; v < 6; ++v){
+			if (vista == (1 << v)){
+				(this->*nucleo(v))(salida, pixelWidth, enParalelo);
+			}
+		}
+	}
+
+	/**
+	* Genera a la vez en salida todas las vistas pedidas en vistas (combinacion de Vista). El alto y el color de cada
+	* casilla se calculan una sola vez y se comparten entre todas.
+	* Si enParalelo es true cada vista va en su hilo (y si solo se pide una, sus filas se reparten entre hilos)
+	*/
+	void getCortes(Cortes &salida, int vistas, int pixelWidth, bool enParalelo = true){
+		preparaCasillas();
+		std::vector<sf::Vertex> *salidas[6] = {
+			&salida.lr, &salida.rl, &salida.front, &salida.lrPuntos, &salida.rlPuntos, &salida.frontPuntos
+		};
+		int pedidas[6];
+		int numPedidas = 0;
+		for (int v = 0; v < 6; ++v){
+			if (vistas & (1 << v)){
+				pedidas[numPedidas++] = v;
+			}
+		}
+		bool filasEnParalelo = enParalelo && numPedidas == 1;
+		auto tarea = [&](int n){
+			int v = pedidas[n];
+			(this->*nucleo(v))(*salidas[v], pixelWidth, filasEnParalelo);
+		};
+		if (enParalelo && numPedidas > 1){
+			paralelo(0, numPedidas, tarea, 1);
+		}
+		else{
+			for (int n = 0; n < numPedidas; ++n){
+				tarea(n);
+			}
+		}
+	}
+
+	/*
+	* Alturas del mapa a lo largo de un segmento (ver getPerfil)
+	*/
+	struct Perfil {
+		std::vector<float> distancias;	// Distancia de cada muestra al origen del segmento, en casillas
+		std::vector<float> alturas;		// Altura del mapa en cada muestra
+		float alturaMin, alturaMax;
+		float subida, bajada;			// Desnivel acumulado en cada sentido, recorriendo el perfil desde el origen
+		float pendienteMedia;			// Media del valor absoluto de la pendiente entre muestras seguidas
+		float pendienteMax;				// Maximo del valor absoluto de la pendiente entre muestras seguidas
 	};
 
+	/**
+	* Altura del mapa en un punto cualquiera (en casillas), interpolando entre las cuatro casillas que lo rodean.
+	* Los puntos fuera del mapa toman la altura del borde mas cercano
+	*/
+	float getAltura(float x, float y) const{
+		int max = size - 1;
+		x = (x < 0) ? 0 : (x > max) ? (float)max : x;
+		y = (y < 0) ? 0 : (y > max) ? (float)max : y;
+		int x0 = (int)x, y0 = (int)y;
+		int x1 = (x0 < max) ? x0 + 1 : x0;
+		int y1 = (y0 < max) ? y0 + 1 : y0;
+		float fx = x - x0, fy = y - y0;
+		float arriba = map[x0 + size * y0] * (1 - fx) + map[x1 + size * y0] * fx;
+		float abajo = map[x0 + size * y1] * (1 - fx) + map[x1 + size * y1] * fx;
+		return arriba * (1 - fy) + abajo * fy;
+	}
+
+	/**
+	* Saca el perfil de alturas del segmento de a a b (en casillas), con una muestra cada paso casillas y otra en b,
+	* junto con su desnivel y sus pendientes
+	*/
+	Perfil getPerfil(sf::Vector2f a, sf::Vector2f b, float paso) const{
+		Perfil ret;
+		sf::Vector2f d = b - a;
+		float longitud = sqrtf(d.x * d.x + d.y * d.y);
+		if (paso <= 0) paso = 1;
+		int muestras = (int)(longitud / paso) + 1;
+		bool finSuelto = longitud - (muestras - 1) * paso > paso * 0.001f;	// b no cae justo en un paso
+		ret.distancias.reserve(muestras + 1);
+		ret.alturas.reserve(muestras + 1);
+		for (int i = 0; i < muestras; ++i){
+			float t = (longitud > 0) ? i * paso / longitud : 0;
+			ret.distancias.push_back(i * paso);
+			ret.alturas.push_back(getAltura(a.x + d.x * t, a.y + d.y * t));
+		}
+		if (finSuelto){
+			ret.distancias.push_back(longitud);
+			ret.alturas.push_back(getAltura(b.x, b.y));
+		}
+		ret.alturaMin = ret.alturaMax = ret.alturas[0];
+		ret.subida = ret.bajada = 0;
+		ret.pendienteMedia = ret.pendienteMax = 0;
+		size_t n = ret.alturas.size();
+		for (size_t i = 1; i < n; ++i){
+			float h = ret.alturas[i];
+			float dh = h - ret.alturas[i - 1];
+			float pendiente = fabs(dh / (ret.distancias[i] - ret.distancias[i - 1]));
+			if (h < ret.alturaMin) ret.alturaMin = h;
+			if (h > ret.alturaMax) ret.alturaMax = h;
+			if (dh > 0) ret.subida += dh;
+			else ret.bajada -= dh;
+			if (pendiente > ret.pendienteMax) ret.pendienteMax = pendiente;
+			ret.pendienteMedia += pendiente;
+		}
+		if (n > 1){
+			ret.pendienteMedia /= (n - 1);
+		}
+		return ret;
+	}
+
+	/**
+	* Saca a la vez los perfiles de muchos segmentos (tramos[i].first a tramos[i].second), repartidos entre hilos.
+	* salida[i] es el perfil del tramo i
+	*/
+	void getPerfiles(const std::vector<std::pair<sf::Vector2f, sf::Vector2f> > &tramos, float paso,
+		std::vector<Perfil> &salida) const{
+		salida.resize(tramos.size());
+		paralelo(0, (int)tramos.size(), [&](int i){
+			salida[i] = getPerfil(tramos[i].first, tramos[i].second, paso);
+		});
+	}
+
+	/**
+	* Devuelve la vista de planta como una imagen de size x size pixeles, uno por casilla.
+	* Para verla mas grande se escala al dibujarla (ver Ventana::show(const sf::Image&, int)), no se repiten pixeles.
+	* Las filas se rellenan en paralelo
+	*/
+	sf::Image getImagenPlanta(){
+		std::vector<sf::Uint8> pixeles(4 * size * size);
+		sf::Uint8 *p = &pixeles[0];
+		paralelo(0, size, [&](int y){
+			sf::Uint8 *fila = p + 4 * size * y;
+			const float *alturas = map + size * y;
+			for (int x = 0; x < size; ++x){
+				const sf::Color &c = colorPaleta(calculaAlto(alturas[x]));
+				fila[4 * x] = c.r;
+				fila[4 * x + 1] = c.g;
+				fila[4 * x + 2] = c.b;
+				fila[4 * x + 3] = c.a;
+			}
+		});
+		sf::Image ret;
+		ret.create(size, size, p);
+		return ret;
+	}
+
 	/**
 	* Muestra el mapa en 2D, como una vista de planta (desde arriba), con un ancho y alto de pixel dados
 	* La llamada a la funcion sin argumentos establece un alto y un  ancho de 5 pixeles por cada valor del
 	* mapa.
+	* Genera un vertice por pixel ((size*pixelWidth)^2 en total), para mapas grandes es mejor getImagenPlanta()
 	*/
 	sf::VertexArray getVistaPlanta(int pixelWidth){
 		int realSize = size*pixelWidth;
@@ -188,7 +546,7 @@ public:
 		for (int i = 0; i < size*size; i++)
 		{
 			alto = calculaAlto(map[i]);
-			color = calculaColor(alto);
+			color = colorPaleta(alto);
 			x = (i % size);
 			y = (i / size);
 			for (int j = 0; j < pixelWidth; ++j){
@@ -213,37 +571,9 @@ public:
 	* (sin espaciado entre lineas)
 	*/
 	sf::VertexArray getCorte3DLR(int pixelWidth){
-		sf::VertexArray ret(sf::PrimitiveType::Lines, 2 * size * size * pixelWidth);
-		int x, y; 
-		sf::Color color;
-		int offset = -1;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			x = (i % size);
-			y = (i / size);
-			if (alto > alturaAgua){
-				color = calculaColorAgua(alto);
-				alto = alturaAgua;
-			}
-			else{
-				color = calculaColor(alto);
-			}
-			for (int j = 0; j < pixelWidth; ++j){
-				int index = (i * 2 * pixelWidth) + 2 * j;
-				ret[index].position.x = (x * pixelWidth + j) + offset;
-				ret[index].position.y = alto + offset;
-				ret[index].color = color;
-				ret[index + 1].position.x = (x * pixelWidth + j) + offset;
-				ret[index + 1].position.y = altoMapa + offset;
-				ret[index + 1].color = color;
-			}
-		}
-		return ret;
+		std::vector<sf::Vertex> vertices;
+		getCorte3D(vertices, LR, pixelWidth);
+		return aVertexArray(vertices, getPrimitiva(LR));
 	}
 
 	/**
@@ -252,34 +582,9 @@ public:
 	* (sin espaciado entre lineas)
 	*/
 	sf::VertexArray getCorte3DLRDotted(int pixelWidth){
-		sf::VertexArray ret(sf::PrimitiveType::Points, size * size * pixelWidth);
-		int x, y;
-		sf::Color color;
-		int offset = -1;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			x = (i % size);
-			y = (i / size);
-			if (alto > alturaAgua){
-				color = calculaColorAgua(alto);
-				alto = alturaAgua;
-			}
-			else{
-				color = calculaColor(alto);
-			}
-			for (int j = 0; j < pixelWidth; ++j){
-				int index = (i * pixelWidth) + j;
-				ret[index].position.x = (x * pixelWidth + j) + offset;
-				ret[index].position.y = alto + offset;
-				ret[index].color = color;
-			}
-		}
-		return ret;
+		std::vector<sf::Vertex> vertices;
+		getCorte3D(vertices, LR_PUNTOS, pixelWidth);
+		return aVertexArray(vertices, getPrimitiva(LR_PUNTOS));
 	}
 
 	/**
@@ -289,37 +594,9 @@ public:
 	*/
 
 	sf::VertexArray getCorte3DRL(int pixelWidth){
-		sf::VertexArray ret(sf::PrimitiveType::Lines, 2 * size * size * pixelWidth);
-		int x, y;
-		sf::Color color;
-		int offset = size + 1;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset--;
-			}
-			alto = calculaAlto(map[i]);
-			x = (i % size);
-			y = (i / size);
-			if (alto > alturaAgua){
-				color = calculaColorAgua(alto);
-				alto = alturaAgua;
-			}
-			else{
-				color = calculaColor(alto);
-			}
-			for (int j = 0; j < pixelWidth; ++j){
-				int index = (i * 2 * pixelWidth) + 2 * j;
-				ret[index].position.x = (x * pixelWidth + j) + offset;
-				ret[index].position.y = alto + size-offset;
-				ret[index].color = color;
-				ret[index + 1].position.x = (x * pixelWidth + j) + offset;
-				ret[index + 1].position.y = altoMapa + size-offset;
-				ret[index + 1].color = color;
-			}
-		}
-		return ret;
+		std::vector<sf::Vertex> vertices;
+		getCorte3D(vertices, RL, pixelWidth);
+		return aVertexArray(vertices, getPrimitiva(RL));
 	}
 
 	/**
@@ -329,34 +606,9 @@ public:
 	*/
 
 	sf::VertexArray getCorte3DRLDotted(int pixelWidth){
-		sf::VertexArray ret(sf::PrimitiveType::Lines, size * size * pixelWidth);
-		int x, y;
-		sf::Color color;
-		int offset = size + 1;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset--;
-			}
-			alto = calculaAlto(map[i]);
-			x = (i % size);
-			y = (i / size);
-			if (alto > alturaAgua){
-				color = calculaColorAgua(alto);
-				alto = alturaAgua;
-			}
-			else{
-				color = calculaColor(alto);
-			}
-			for (int j = 0; j < pixelWidth; ++j){
-				int index = (i * pixelWidth) + j;
-				ret[index].position.x = (x * pixelWidth + j) + offset;
-				ret[index].position.y = alto + size - offset;
-				ret[index].color = color;
-			}
-		}
-		return ret;
+		std::vector<sf::Vertex> vertices;
+		getCorte3D(vertices, RL_PUNTOS, pixelWidth);
+		return aVertexArray(vertices, getPrimitiva(RL_PUNTOS));
 	}
 
 	/**
@@ -365,37 +617,9 @@ public:
 	* (sin espaciado entre lineas)
 	*/
 	sf::VertexArray getCorte3DFront(int pixelWidth){
-		sf::VertexArray ret(sf::PrimitiveType::Lines, 2 * size * size * pixelWidth);
-		int x, y;
-		int offset = -1;
-		sf::Color color;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			x = (i % size);
-			y = (i / size);
-			if (alto > alturaAgua){
-				color = calculaColorAgua(alto);
-				alto = alturaAgua;
-			}
-			else{
-				color = calculaColor(alto);
-			}
-			for (int j = 0; j < pixelWidth; ++j){
-				int index = (i * 2 * pixelWidth) + 2 * j;
-				ret[index].position.x = (x * pixelWidth + j);
-				ret[index].position.y = alto + offset;
-				ret[index].color = color;
-				ret[index + 1].position.x = (x * pixelWidth + j);
-				ret[index + 1].position.y = altoMapa + offset;
-				ret[index + 1].color = color;
-			}
-		}
-		return ret;
+		std::vector<sf::Vertex> vertices;
+		getCorte3D(vertices, FRONT, pixelWidth);
+		return aVertexArray(vertices, getPrimitiva(FRONT));
 	}
 
 	/**
@@ -404,34 +628,9 @@ public:
 	* (sin espaciado entre lineas)
 	*/
 	sf::VertexArray getCorte3DFrontDotted(int pixelWidth){
-		sf::VertexArray ret(sf::PrimitiveType::Lines, size * size * pixelWidth);
-		int x, y;
-		int offset = -1;
-		sf::Color color;
-		int alto;
-		for (int i = 0; i < size*size; ++i)
-		{
-			if (i%size == 0){
-				offset++;
-			}
-			alto = calculaAlto(map[i]);
-			x = (i % size);
-			y = (i / size);
-			if (alto > alturaAgua){
-				color = calculaColorAgua(alto);
-				alto = alturaAgua;
-			}
-			else{
-				color = calculaColor(alto);
-			}
-			for (int j = 0; j < pixelWidth; ++j){
-				int index = (i * pixelWidth) + j;
-				ret[index].position.x = (x * pixelWidth + j);
-				ret[index].position.y = alto + offset;
-				ret[index].color = color;
-			}
-		}
-		return ret;
+		std::vector<sf::Vertex> vertices;
+		getCorte3D(vertices, FRONT_PUNTOS, pixelWidth);
+		return aVertexArray(vertices, getPrimitiva(FRONT_PUNTOS));
 	}
 
 	/**
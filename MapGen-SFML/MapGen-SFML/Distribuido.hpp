@@ -0,0 +1,544 @@
+#ifndef DISTRIBUIDO_HPP
+#define DISTRIBUIDO_HPP
+
+#include <SFML\Graphics.hpp>
+#include <SFML\Network.hpp>
+#include <Windows.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include "Mundo.hpp"
+#include "ArchivoMapa.hpp"
+#include "CodecAlturas.hpp"
+#include "Paralelo.hpp"
+
+/*
+* Generacion de un Mundo repartida entre procesos: un Coordinador parte el mundo en teselas y se las va mandando a
+* Trabajadores conectados por TCP, que las generan y le devuelven las alturas ya comprimidas. El coordinador las
+* guarda en un directorio, una por archivo (formato ArchivoMapa COMPRIMIDO, nombres de Mundo::archivoTesela), con
+* un indice mundo.txt con los parametros.
+*
+* Los trabajadores pueden ser procesos del mismo programa lanzados por el coordinador (MapGen-SFML --trabajador
+* servidor puerto) o, si el coordinador acepta conexiones de fuera, el mismo programa en otras maquinas.
+*
+* Protocolo (sf::Packet, el primer campo es el tipo de mensaje):
+*
+*	trabajador -> coordinador	HOLA version
+*	coordinador -> trabajador	TRABAJO id tx ty detalle semilla roughness
+*	trabajador -> coordinador	RESULTADO id milisegundos alturaMin alturaMax hash datos
+*	coordinador -> trabajador	FIN
+*/
+class Protocolo {
+public:
+
+	enum Mensaje { HOLA = 1, TRABAJO = 2, RESULTADO = 3, FIN = 4 };
+
+	static const sf::Uint32 VERSION = 1;
+
+	/**
+	* FNV-1a de 64 bits de los datos de un resultado, para descartar los que lleguen mal
+	*/
+	static sf::Uint64 hash(const std::string &datos){
+		sf::Uint64 h = 14695981039346656037ULL;
+		for (size_t i = 0; i < datos.size(); ++i){
+			h ^= (sf::Uint8)datos[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+};
+
+/*
+* Lado del trabajador: genera las teselas que le pide un coordinador, de una en una
+*/
+class Trabajador {
+public:
+
+	/**
+	* Se conecta al coordinador de servidor:puerto y trabaja hasta que le manda FIN. Devuelve false si no se puede
+	* conectar o la conexion se corta antes
+	*/
+	static bool ejecuta(const sf::IpAddress &servidor, unsigned short puerto){
+		sf::TcpSocket s;
+		if (s.connect(servidor, puerto, sf::seconds(10)) != sf::Socket::Done){
+			std::cout << "Trabajador: no se puede conectar a " << servidor << ":" << puerto << std::endl;
+			return false;
+		}
+		sf::Packet hola;
+		hola << (sf::Uint8)Protocolo::HOLA << Protocolo::VERSION;
+		if (s.send(hola) != sf::Socket::Done) return false;
+
+		std::vector<float> alturas;
+		std::vector<sf::Uint8> datos;
+		for (;;){
+			sf::Packet m;
+			if (s.receive(m) != sf::Socket::Done) return false;
+			sf::Uint8 tipo = 0;
+			m >> tipo;
+			if (tipo == Protocolo::FIN) return true;
+			sf::Uint32 id, semilla;
+			sf::Int32 tx, ty, detalle;
+			float roughness;
+			if (tipo != Protocolo::TRABAJO || !(m >> id >> tx >> ty >> detalle >> semilla >> roughness) ||
+				detalle < 1 || detalle > 13){
+				std::cout << "Trabajador: mensaje incorrecto" << std::endl;
+				return false;
+			}
+			sf::Clock reloj;
+			Mundo::Parametros p = { detalle, 0, 0, semilla, roughness };
+			int size = (1 << detalle) + 1;
+			alturas.resize((size_t)size * size);
+			Mundo::generaTesela(p, tx, ty, &alturas[0]);
+			CodecAlturas::codifica(&alturas[0], size, datos);
+			auto extremos = std::minmax_element(alturas.begin(), alturas.end());
+			std::string d(datos.begin(), datos.end());
+
+			sf::Packet r;
+			r << (sf::Uint8)Protocolo::RESULTADO << id << (sf::Uint32)reloj.getElapsedTime().asMilliseconds()
+				<< *extremos.first << *extremos.second << Protocolo::hash(d) << d;
+			if (s.send(r) != sf::Socket::Done) return false;
+		}
+	}
+};
+
+/*
+* Lado del coordinador. Cada trabajador tiene su propia cola de teselas, que se rellena con un trozo seguido de las
+* que quedan sin asignar (teselas vecinas, trozos mas pequenos cuanto menos queda). Cuando un trabajador vacia su cola
+* y ya no quedan sin asignar, roba la mitad del final de la cola mas larga de otro: asi los trabajadores rapidos no se
+* quedan parados al final esperando a los lentos. Cada trabajador tiene siempre dos teselas pedidas, para que no
+* espere entre una y otra.
+* Si un trabajador se desconecta o tarda demasiado en una tesela, sus teselas vuelven a repartirse; una tesela que
+* falla MAX_INTENTOS veces se da por perdida. Las teselas que ya estan en el directorio (de una ejecucion anterior
+* con los mismos parametros) no se vuelven a generar
+*/
+class Coordinador {
+public:
+
+	struct EstadisticasTrabajador {
+		std::string nombre;
+		int teselas;
+		int fallos;
+		sf::Uint64 bytes;
+		double segundosGenerando;	// Lo que dice el trabajador que ha tardado en generar
+		double segundosConectado;
+	};
+
+	static const int MAX_INTENTOS = 3;
+	static const int EN_VUELO = 2;
+
+private:
+
+	struct Conexion {
+		std::unique_ptr<sf::TcpSocket> socket;
+		bool saludado;
+		std::deque<int> cola;			// Teselas asignadas y sin enviar: se cogen por delante y se roban por detras
+		std::map<int, sf::Time> enVuelo;	// Tesela enviada -> cuando
+		sf::Time desde;
+		EstadisticasTrabajador estadisticas;
+	};
+
+	struct Resultado {
+		int tesela;
+		float alturaMin, alturaMax;
+		std::string datos;
+	};
+
+	Mundo::Parametros parametros;
+	std::string directorio;
+	sf::Time plazo;
+	int total;
+	std::vector<int> intentos;
+	std::deque<int> sinAsignar;
+	int hechas, fallidas;
+	std::vector<std::unique_ptr<Conexion> > conexiones;
+	std::vector<EstadisticasTrabajador> estadisticas;
+	sf::TcpListener escucha;
+	sf::SocketSelector selector;
+	sf::Clock reloj;
+	std::unique_ptr<ColaAcotada<Resultado> > escritura;
+	std::atomic<bool> errorEscritura;
+	std::atomic<bool> cancelado;
+
+	std::string rutaTesela(int t) const{
+		return directorio + "\\" + Mundo::archivoTesela(t % parametros.teselasX, t / parametros.teselasX);
+	}
+
+	static bool existe(const std::string &ruta){
+		return GetFileAttributesA(ruta.c_str()) != INVALID_FILE_ATTRIBUTES;
+	}
+
+	std::string indice() const{
+		std::ostringstream s;
+		s << "generador " << Mundo::VERSION_GENERADOR << "\n"
+			<< "detalle " << parametros.detalle << "\n"
+			<< "teselas " << parametros.teselasX << " " << parametros.teselasY << "\n"
+			<< "semilla " << parametros.semilla << "\n"
+			<< "roughness " << parametros.roughness << "\n";
+		return s.str();
+	}
+
+	/**
+	* Borra las teselas que haya en el directorio. Devuelve false si alguna no se puede borrar
+	*/
+	bool borraTeselas(){
+		WIN32_FIND_DATAA datos;
+		HANDLE busqueda = FindFirstFileA((directorio + "\\*.mgs").c_str(), &datos);
+		if (busqueda == INVALID_HANDLE_VALUE) return true;
+		bool ok = true;
+		do{
+			if (datos.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+			std::string archivo = directorio + "\\" + datos.cFileName;
+			if (!DeleteFileA(archivo.c_str())){
+				std::cout << archivo << ": no se puede borrar (" << GetLastError() << ")" << std::endl;
+				ok = false;
+			}
+		} while (FindNextFileA(busqueda, &datos));
+		FindClose(busqueda);
+		return ok;
+	}
+
+	/**
+	* Escribe el indice del mundo y devuelve true si el que habia era el mismo (las teselas que hay valen).
+	* Si no, borra antes las teselas de la ejecucion anterior: si esta se corta a medias, la siguiente no puede dar
+	* por buenas teselas de otros parametros. Si alguna no se puede borrar se deja el indice viejo, para que la
+	* siguiente ejecucion lo vuelva a intentar
+	*/
+	bool preparaDirectorio(){
+		CreateDirectoryA(directorio.c_str(), NULL);
+		std::string ruta = directorio + "\\mundo.txt";
+		std::string actual = indice();
+		std::ifstream anterior(ruta.c_str());
+		std::stringstream leido;
+		leido << anterior.rdbuf();
+		anterior.close();
+		if (leido.str() == actual) return true;
+		if (!borraTeselas()) return false;
+		std::ofstream f(ruta.c_str(), std::ios::trunc);
+		f << actual;
+		return false;
+	}
+
+	/**
+	* Siguiente tesela para c: de su cola, de las sin asignar o robada a otro. -1 si no queda ninguna
+	*/
+	int siguiente(Conexion &c){
+		if (c.cola.empty() && !sinAsignar.empty()){
+			size_t n = (std::max)((size_t)1, sinAsignar.size() / (2 * conexiones.size()));
+			for (size_t i = 0; i < n; ++i){
+				c.cola.push_back(sinAsignar.front());
+				sinAsignar.pop_front();
+			}
+		}
+		if (c.cola.empty()){
+			Conexion *victima = nullptr;
+			for (auto &o : conexiones){
+				if (o.get() != &c && (victima == nullptr || o->cola.size() > victima->cola.size())){
+					victima = o.get();
+				}
+			}
+			if (victima != nullptr && !victima->cola.empty()){
+				size_t n = (victima->cola.size() + 1) / 2;
+				c.cola.insert(c.cola.end(), victima->cola.end() - n, victima->cola.end());
+				victima->cola.erase(victima->cola.end() - n, victima->cola.end());
+			}
+		}
+		if (c.cola.empty()) return -1;
+		int t = c.cola.front();
+		c.cola.pop_front();
+		return t;
+	}
+
+	/**
+	* Manda a c teselas hasta tener EN_VUELO. Devuelve false si falla el envio
+	*/
+	bool envia(Conexion &c){
+		while (c.saludado && (int)c.enVuelo.size() < EN_VUELO){
+			int t = siguiente(c);
+			if (t < 0) break;
+			c.enVuelo[t] = reloj.getElapsedTime();
+			sf::Packet m;
+			m << (sf::Uint8)Protocolo::TRABAJO << (sf::Uint32)t << (sf::Int32)(t % parametros.teselasX)
+				<< (sf::Int32)(t / parametros.teselasX) << (sf::Int32)parametros.detalle << parametros.semilla
+				<< parametros.roughness;
+			if (c.socket->send(m) != sf::Socket::Done) return false;
+		}
+		return true;
+	}
+
+	/**
+	* Una tesela no se ha podido generar: vuelve a repartirse o, si ya ha fallado demasiadas veces, se da por perdida
+	*/
+	void reintenta(int t){
+		if (++intentos[t] >= MAX_INTENTOS){
+			std::cout << rutaTesela(t) << ": no se ha podido generar" << std::endl;
+			++fallidas;
+		}
+		else{
+			sinAsignar.push_front(t);
+		}
+	}
+
+	void desconecta(size_t i, const char *motivo){
+		Conexion &c = *conexiones[i];
+		std::cout << "Coordinador: " << c.estadisticas.nombre << " " << motivo << std::endl;
+		for (auto &v : c.enVuelo){
+			reintenta(v.first);
+		}
+		sinAsignar.insert(sinAsignar.begin(), c.cola.begin(), c.cola.end());
+		c.estadisticas.segundosConectado = (reloj.getElapsedTime() - c.desde).asSeconds();
+		estadisticas.push_back(c.estadisticas);
+		selector.remove(*c.socket);
+		c.socket->disconnect();
+		conexiones.erase(conexiones.begin() + i);
+	}
+
+	/**
+	* Atiende un mensaje de c. Devuelve false si no es valido
+	*/
+	bool recibe(Conexion &c, sf::Packet &m){
+		sf::Uint8 tipo = 0;
+		m >> tipo;
+		if (tipo == Protocolo::HOLA){
+			sf::Uint32 version = 0;
+			m >> version;
+			if (version != Protocolo::VERSION) return false;
+			c.saludado = true;
+			return true;
+		}
+		Resultado r;
+		sf::Uint32 id, ms;
+		sf::Uint64 h;
+		if (tipo != Protocolo::RESULTADO || !(m >> id >> ms >> r.alturaMin >> r.alturaMax >> h >> r.datos)) return false;
+		auto v = c.enVuelo.find((int)id);
+		if (v == c.enVuelo.end()) return false;
+		c.enVuelo.erase(v);
+		r.tesela = (int)id;
+		int size = (1 << parametros.detalle) + 1;
+		if (Protocolo::hash(r.datos) != h ||
+			CodecAlturas::leeSize((const sf::Uint8*)r.datos.data(), r.datos.size()) != size){
+			++c.estadisticas.fallos;
+			reintenta(r.tesela);
+			return true;
+		}
+		++c.estadisticas.teselas;
+		c.estadisticas.bytes += r.datos.size();
+		c.estadisticas.segundosGenerando += ms / 1000.0;
+		++hechas;
+		escritura->mete(std::move(r));
+		return true;
+	}
+
+	void escribe(){
+		Resultado r;
+		while (escritura->saca(r)){
+			std::string ruta = rutaTesela(r.tesela);
+			std::string temporal = ruta + ".tmp";
+			if (!ArchivoMapa::guardaComprimido(temporal, parametros.detalle, parametros.semilla, parametros.roughness,
+				r.alturaMin, r.alturaMax, r.datos) || !MoveFileExA(temporal.c_str(), ruta.c_str(), MOVEFILE_REPLACE_EXISTING)){
+				errorEscritura = true;
+			}
+		}
+	}
+
+	/**
+	* Lanza n procesos de este mismo programa como trabajadores de localhost:puerto
+	*/
+	static void lanza(int n, unsigned short puerto, std::vector<HANDLE> &procesos){
+		char programa[MAX_PATH];
+		GetModuleFileNameA(NULL, programa, MAX_PATH);
+		std::ostringstream linea;
+		linea << "\"" << programa << "\" --trabajador 127.0.0.1 " << puerto;
+		for (int i = 0; i < n; ++i){
+			std::string l = linea.str();
+			std::vector<char> texto(l.begin(), l.end());
+			texto.push_back(0);
+			STARTUPINFOA si;
+			PROCESS_INFORMATION pi;
+			memset(&si, 0, sizeof(si));
+			si.cb = sizeof(si);
+			if (!CreateProcessA(programa, &texto[0], NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi)){
+				std::cout << "Coordinador: no se puede lanzar un trabajador (" << GetLastError() << ")" << std::endl;
+				continue;
+			}
+			CloseHandle(pi.hThread);
+			procesos.push_back(pi.hProcess);
+		}
+	}
+
+public:
+
+	/**
+	* Coordinador que genera el mundo de parametros en directorio
+	*/
+	Coordinador(const Mundo::Parametros &parametros, const std::string &directorio) :
+		parametros(parametros),
+		directorio(directorio),
+		plazo(sf::seconds(120)),
+		total(parametros.teselasX * parametros.teselasY),
+		hechas(0),
+		fallidas(0),
+		errorEscritura(false),
+		cancelado(false)
+	{
+	}
+
+	/**
+	* Tiempo maximo que puede tardar un trabajador en devolver una tesela antes de darle por caido
+	*/
+	void setPlazo(sf::Time p){
+		plazo = p;
+	}
+
+	/**
+	* Se puede llamar desde otro hilo mientras ejecuta(): deja de repartir teselas, despide a los trabajadores y
+	* ejecuta() devuelve false en cuanto termina de guardar lo que ya tenia. Las teselas guardadas valen para reanudar
+	* con otro Coordinador; este ya no vuelve a generar
+	*/
+	void cancela(){
+		cancelado = true;
+	}
+
+	/**
+	* Genera el mundo con locales procesos trabajadores en esta maquina, escuchando en puerto. Si remotos es true
+	* tambien acepta trabajadores de otras maquinas (si no, solo de localhost); con locales = 0 solo trabaja con los
+	* que se conecten. Devuelve false si alguna tesela no se ha podido generar o guardar
+	*/
+	bool ejecuta(int locales, unsigned short puerto, bool remotos = false){
+		bool mismoMundo = preparaDirectorio();
+		intentos.assign(total, 0);
+		sinAsignar.clear();
+		hechas = fallidas = 0;
+		for (int t = 0; t < total; ++t){
+			if (mismoMundo && existe(rutaTesela(t))) ++hechas;
+			else sinAsignar.push_back(t);
+		}
+		if (hechas == total) return true;
+		if (escucha.listen(puerto, remotos ? sf::IpAddress::Any : sf::IpAddress::LocalHost) != sf::Socket::Done){
+			std::cout << "Coordinador: no se puede escuchar en el puerto " << puerto << std::endl;
+			return false;
+		}
+		selector.clear();
+		selector.add(escucha);
+		estadisticas.clear();
+		errorEscritura = false;
+		escritura.reset(new ColaAcotada<Resultado>(64));
+		std::thread escritor(&Coordinador::escribe, this);
+		std::vector<HANDLE> procesos;
+		lanza(locales, puerto, procesos);
+
+		reloj.restart();
+		sf::Time ultimaConexion;
+		int yaHechas = hechas;
+		while (hechas + fallidas < total && !cancelado){
+			if (selector.wait(sf::milliseconds(100))){
+				if (selector.isReady(escucha)){
+					std::unique_ptr<Conexion> c(new Conexion());
+					c->socket.reset(new sf::TcpSocket());
+					if (escucha.accept(*c->socket) == sf::Socket::Done){
+						c->saludado = false;
+						c->desde = reloj.getElapsedTime();
+						std::ostringstream nombre;
+						nombre << c->socket->getRemoteAddress() << ":" << c->socket->getRemotePort();
+						c->estadisticas.nombre = nombre.str();
+						c->estadisticas.teselas = c->estadisticas.fallos = 0;
+						c->estadisticas.bytes = 0;
+						c->estadisticas.segundosGenerando = c->estadisticas.segundosConectado = 0;
+						selector.add(*c->socket);
+						conexiones.push_back(std::move(c));
+					}
+				}
+				for (size_t i = conexiones.size(); i-- > 0;){
+					if (!selector.isReady(*conexiones[i]->socket)) continue;
+					sf::Packet m;
+					if (conexiones[i]->socket->receive(m) != sf::Socket::Done){
+						desconecta(i, "se ha desconectado");
+					}
+					else if (!recibe(*conexiones[i], m)){
+						desconecta(i, "ha mandado un mensaje incorrecto");
+					}
+				}
+			}
+			sf::Time ahora = reloj.getElapsedTime();
+			for (size_t i = conexiones.size(); i-- > 0;){
+				Conexion &c = *conexiones[i];
+				bool tarde = false;
+				for (auto &v : c.enVuelo){
+					if (ahora - v.second > plazo) tarde = true;
+				}
+				if (tarde){
+					desconecta(i, "no contesta");
+				}
+				else if (!envia(c)){
+					desconecta(i, "se ha desconectado");
+				}
+			}
+			if (!conexiones.empty()){
+				ultimaConexion = ahora;
+			}
+			else if (ahora - ultimaConexion > sf::seconds(30)){
+				std::cout << "Coordinador: no hay trabajadores" << std::endl;
+				break;
+			}
+		}
+
+		for (size_t i = conexiones.size(); i-- > 0;){
+			sf::Packet fin;
+			fin << (sf::Uint8)Protocolo::FIN;
+			conexiones[i]->socket->send(fin);
+			conexiones[i]->estadisticas.segundosConectado = (reloj.getElapsedTime() - conexiones[i]->desde).asSeconds();
+			estadisticas.push_back(conexiones[i]->estadisticas);
+			conexiones[i]->socket->disconnect();
+		}
+		conexiones.clear();
+		selector.clear();
+		escucha.close();
+		escritura->cierra();
+		escritor.join();
+		for (HANDLE p : procesos){
+			if (WaitForSingleObject(p, 5000) != WAIT_OBJECT_0){
+				TerminateProcess(p, 1);
+			}
+			CloseHandle(p);
+		}
+
+		double segundos = reloj.getElapsedTime().asSeconds();
+		std::ios::fmtflags formato = std::cout.flags();
+		std::streamsize precision = std::cout.precision();
+		std::cout << "Mundo: " << hechas - yaHechas << " teselas en " << std::fixed << std::setprecision(1) << segundos
+			<< " s (" << (hechas - yaHechas) / (std::max)(segundos, 0.001) << " teselas/s)" << std::endl;
+		for (auto &e : estadisticas){
+			std::cout << "  " << e.nombre << ": " << e.teselas << " teselas, "
+				<< e.teselas / (std::max)(e.segundosConectado, 0.001) << " teselas/s, ocupado "
+				<< 100 * e.segundosGenerando / (std::max)(e.segundosConectado, 0.001) << "%, "
+				<< e.bytes / 1048576.0 << " MB";
+			if (e.fallos > 0) std::cout << ", " << e.fallos << " resultados incorrectos";
+			std::cout << std::endl;
+		}
+		std::cout.flags(formato);
+		std::cout.precision(precision);
+		if (cancelado){
+			std::cout << "Coordinador: cancelado con " << hechas << " de " << total << " teselas" << std::endl;
+		}
+		if (errorEscritura){
+			std::cout << directorio << ": no se han podido guardar todas las teselas" << std::endl;
+		}
+		return hechas == total && !errorEscritura;
+	}
+
+	/**
+	* Estadisticas de cada trabajador de la ultima ejecucion
+	*/
+	const std::vector<EstadisticasTrabajador> &getEstadisticas() const{
+		return estadisticas;
+	}
+};
+
+#endif
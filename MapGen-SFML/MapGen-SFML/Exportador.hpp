@@ -0,0 +1,178 @@
+#ifndef EXPORTADOR_HPP
+#define EXPORTADOR_HPP
+
+#include <SFML\Graphics.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cfloat>
+#include "Map.hpp"
+#include "Png.hpp"
+#include "Paralelo.hpp"
+
+/*
+* Exporta el mapa de alturas a imagenes para otras herramientas:
+*
+*	- PGM de 16 bits en gris (P5, maximo 65535).
+*	- PNG de 16 bits en gris.
+*	- PNG en color con los colores del mapa, como imagen indexada (cada altura entera es una entrada de la paleta).
+*
+* Las alturas se escalan al rango de 16 bits entre la minima y la maxima del mapa.
+* Todo se hace por filas: un hilo lee y prepara cada fila (conversion y filtro PNG) mientras el que llama la comprime
+* y la escribe, con una cola de FILAS_EN_COLA filas entre los dos. La memoria no depende del tamano del mapa, asi que
+* se puede exportar un mapa proyectado desde archivo (ver ArchivoMapa) sin llegar a tenerlo entero en memoria
+*/
+class Exportador {
+private:
+
+	static const int FILAS_EN_COLA = 8;
+
+	/**
+	* Ejecuta produce(y, fila) para cada fila en un hilo aparte y consume(fila) en este, en orden. Si consume
+	* devuelve false se para todo y devuelve false
+	*/
+	template <class Produce, class Consume>
+	static bool canaliza(int filas, Produce produce, Consume consume){
+		ColaAcotada<std::vector<sf::Uint8> > cola(FILAS_EN_COLA);
+		std::thread productor([&](){
+			for (int y = 0; y < filas; ++y){
+				std::vector<sf::Uint8> fila;
+				produce(y, fila);
+				if (!cola.mete(std::move(fila))) break;
+			}
+			cola.cierra();
+		});
+		bool bien = true;
+		std::vector<sf::Uint8> fila;
+		while (cola.saca(fila)){
+			if (!consume(fila)){
+				bien = false;
+				cola.cierra();
+				break;
+			}
+		}
+		productor.join();
+		return bien;
+	}
+
+	static void rango(const float *map, int size, float &minimo, float &maximo){
+		minimo = FLT_MAX;
+		maximo = -FLT_MAX;
+		for (int i = 0; i < size * size; ++i){
+			if (map[i] < minimo) minimo = map[i];
+			if (map[i] > maximo) maximo = map[i];
+		}
+	}
+
+	/**
+	* Pasa la fila y a 16 bits big-endian (el orden de PGM y PNG) entre minimo y minimo + 65535 / escala
+	*/
+	static void fila16(const float *map, int size, int y, float minimo, float escala, sf::Uint8 *salida){
+		const float *fila = map + size * y;
+		for (int x = 0; x < size; ++x){
+			float v = (fila[x] - minimo) * escala + 0.5f;
+			sf::Uint16 h = (sf::Uint16)((v < 0) ? 0 : (v > 65535) ? 65535 : v);
+			salida[2 * x] = (sf::Uint8)(h >> 8);
+			salida[2 * x + 1] = (sf::Uint8)h;
+		}
+	}
+
+	static float escala16(float minimo, float maximo){
+		return (maximo > minimo) ? 65535 / (maximo - minimo) : 0;
+	}
+
+	static bool abre(std::ofstream &f, const std::string &ruta){
+		f.open(ruta.c_str(), std::ios::binary | std::ios::trunc);
+		if (!f){
+			std::cout << ruta << ": no se puede escribir" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+public:
+
+	/**
+	* Escribe las alturas como PGM de 16 bits
+	*/
+	static bool pgm16(const float *map, int size, std::ostream &salida){
+		float minimo, maximo;
+		rango(map, size, minimo, maximo);
+		float escala = escala16(minimo, maximo);
+		salida << "P5\n" << size << " " << size << "\n65535\n";
+		return canaliza(size, [&](int y, std::vector<sf::Uint8> &fila){
+			fila.resize(2 * size);
+			fila16(map, size, y, minimo, escala, &fila[0]);
+		}, [&](const std::vector<sf::Uint8> &fila){
+			salida.write((const char*)&fila[0], fila.size());
+			return !!salida;
+		}) && !!salida.flush();
+	}
+
+	/**
+	* Escribe las alturas como PNG de 16 bits en gris
+	*/
+	static bool png16(const float *map, int size, std::ostream &salida){
+		float minimo, maximo;
+		rango(map, size, minimo, maximo);
+		float escala = escala16(minimo, maximo);
+		EscritorPng png(salida, size, size, 16, EscritorPng::GRIS);
+		FiltroPng filtro(2 * size, 2);
+		std::vector<sf::Uint8> cruda(2 * size);
+		bool bien = canaliza(size, [&](int y, std::vector<sf::Uint8> &fila){
+			fila16(map, size, y, minimo, escala, &cruda[0]);
+			filtro.filtra(&cruda[0], fila);
+		}, [&](const std::vector<sf::Uint8> &fila){
+			png.fila(&fila[0], fila.size());
+			return !!salida;
+		});
+		return png.termina() && bien;
+	}
+
+	/**
+	* Escribe el mapa en color (sin sombreado) como PNG indexado: la paleta son los colores de las alturas 0 a 255
+	* (Map::colorAltura) y cada pixel es la altura de su casilla
+	*/
+	static bool pngColor(const Map &m, std::ostream &salida){
+		const float *map = m.getMapa();
+		int size = m.getSize();
+		std::vector<sf::Color> paleta(256);
+		for (int h = 0; h < 256; ++h){
+			paleta[h] = m.colorAltura(h);
+		}
+		EscritorPng png(salida, size, size, 8, EscritorPng::INDEXADO, &paleta);
+		FiltroPng filtro(size, 1);
+		std::vector<sf::Uint8> cruda(size);
+		bool bien = canaliza(size, [&](int y, std::vector<sf::Uint8> &fila){
+			const float *alturas = map + size * y;
+			for (int x = 0; x < size; ++x){
+				float h = alturas[x] + 0.5f;
+				cruda[x] = (sf::Uint8)((h < 0) ? 0 : (h > 255) ? 255 : h);
+			}
+			filtro.filtra(&cruda[0], fila);
+		}, [&](const std::vector<sf::Uint8> &fila){
+			png.fila(&fila[0], fila.size());
+			return !!salida;
+		});
+		return png.termina() && bien;
+	}
+
+	static bool pgm16(const Map &m, const std::string &ruta){
+		std::ofstream f;
+		return abre(f, ruta) && pgm16(m.getMapa(), m.getSize(), f);
+	}
+
+	static bool png16(const Map &m, const std::string &ruta){
+		std::ofstream f;
+		return abre(f, ruta) && png16(m.getMapa(), m.getSize(), f);
+	}
+
+	static bool pngColor(const Map &m, const std::string &ruta){
+		std::ofstream f;
+		return abre(f, ruta) && pngColor(m, f);
+	}
+};
+
+#endif
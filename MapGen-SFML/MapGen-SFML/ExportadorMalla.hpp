@@ -0,0 +1,323 @@
+#ifndef EXPORTADORMALLA_HPP
+#define EXPORTADORMALLA_HPP
+
+#include <SFML\Graphics.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include "Map.hpp"
+#include "Paralelo.hpp"
+
+/*
+* Exporta el terreno como malla de triangulos con indices para herramientas 3D:
+*
+*	- PLY binario (little-endian), con el color de cada vertice.
+*	- OBJ (texto).
+*
+* Los vertices son las casillas del mapa (o una de cada paso casillas) en coordenadas del mapa: x e y la casilla y z
+* la altura. Cada cuadrado de la rejilla son dos triangulos en sentido antihorario vistos desde arriba.
+*
+* No se construye la malla en memoria: los vertices y los triangulos se generan por filas, cada lote de filas se
+* formatea en paralelo (una fila por tarea) y se escribe en orden antes de pasar al siguiente lote.
+*
+* Para archivos mas pequenos se puede simplificar con una tolerancia: se usa el mayor paso con el que ninguna casilla
+* queda a mas de esa altura de la superficie de los triangulos (ver errorPaso). Tambien se puede escribir cualquier
+* otra malla del mapa, como las de Triangulacion, que con la misma tolerancia tienen muchos menos triangulos
+*/
+class ExportadorMalla {
+private:
+
+	static const int FILAS_POR_LOTE = 64;
+	static const int ELEMENTOS_POR_TROZO = 4096;	// Puntos o triangulos de cada tarea al escribir una malla cualquiera
+
+	/**
+	* Escribe en salida el resultado de formatea(i, trozo) para i en [0, n), calculando los trozos en paralelo por lotes
+	*/
+	template <class Formatea>
+	static bool escribePorLotes(std::ostream &salida, int n, Formatea formatea){
+		std::vector<std::string> trozos(FILAS_POR_LOTE);
+		for (int inicio = 0; inicio < n && salida; inicio += FILAS_POR_LOTE){
+			int fin = (std::min)(n, inicio + FILAS_POR_LOTE);
+			paralelo(inicio, fin, [&](int i){
+				std::string &trozo = trozos[i - inicio];
+				trozo.clear();
+				formatea(i, trozo);
+			}, 1);
+			for (int i = inicio; i < fin; ++i){
+				salida.write(trozos[i - inicio].data(), trozos[i - inicio].size());
+			}
+		}
+		return !!salida;
+	}
+
+	static void entero(std::string &s, sf::Int64 v){
+		if (v < 0){
+			s += '-';
+			v = -v;
+		}
+		char cifras[20];
+		int n = 0;
+		do{
+			cifras[n++] = (char)('0' + v % 10);
+			v /= 10;
+		} while (v > 0);
+		while (n > 0) s += cifras[--n];
+	}
+
+	/**
+	* Escribe v en texto con hasta 4 decimales (las alturas generadas son enteras y salen sin decimales)
+	*/
+	static void numero(std::string &s, float v){
+		if (v < 0){
+			s += '-';
+			v = -v;
+		}
+		sf::Int64 fijo = (sf::Int64)(v * 10000.0 + 0.5);
+		entero(s, fijo / 10000);
+		int decimales = (int)(fijo % 10000);
+		if (decimales == 0) return;
+		char cifras[4];
+		for (int k = 3; k >= 0; --k){
+			cifras[k] = (char)('0' + decimales % 10);
+			decimales /= 10;
+		}
+		int n = 4;
+		while (cifras[n - 1] == '0') --n;
+		s += '.';
+		s.append(cifras, n);
+	}
+
+	template <class T>
+	static void binario(std::string &s, T v){
+		s.append((const char*)&v, sizeof(T));
+	}
+
+	/**
+	* Llama a f(a, b, c) para los dos triangulos de cada cuadrado de la fila J de la rejilla de lado vertices
+	*/
+	template <class F>
+	static void triangulosFila(int lado, int J, F f){
+		for (int I = 0; I + 1 < lado; ++I){
+			sf::Uint32 a = I + lado * J, b = a + 1, c = b + lado, d = a + lado;
+			f(a, b, c);
+			f(a, c, d);
+		}
+	}
+
+	static int lado(const Map &m, int paso){
+		return (m.getSize() - 1) / paso + 1;
+	}
+
+	static bool abre(std::ofstream &f, const std::string &ruta){
+		f.open(ruta.c_str(), std::ios::binary | std::ios::trunc);
+		if (!f){
+			std::cout << ruta << ": no se puede escribir" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+public:
+
+	/**
+	* Mayor diferencia de altura entre una casilla y la superficie de los triangulos de la rejilla con un vertice cada
+	* paso casillas. Se calcula en paralelo
+	*/
+	static float errorPaso(const Map &m, int paso){
+		const float *map = m.getMapa();
+		int size = m.getSize();
+		int n = lado(m, paso) - 1;
+		std::vector<float> errores(n > 0 ? n : 1, 0);
+		paralelo(0, n, [&](int J){
+			float e = 0;
+			int y0 = J * paso;
+			for (int x0 = 0; x0 + paso < size; x0 += paso){
+				float a = map[x0 + size * y0], b = map[x0 + paso + size * y0];
+				float c = map[x0 + paso + size * (y0 + paso)], d = map[x0 + size * (y0 + paso)];
+				for (int v = 0; v <= paso; ++v){
+					for (int u = 0; u <= paso; ++u){
+						float fu = (float)u / paso, fv = (float)v / paso;
+						float h = (u >= v) ? a + (b - a) * fu + (c - b) * fv : a + (d - a) * fv + (c - d) * fu;
+						e = (std::max)(e, fabsf(h - map[x0 + u + size * (y0 + v)]));
+					}
+				}
+			}
+			errores[J] = e;
+		}, 1);
+		return *std::max_element(errores.begin(), errores.end());
+	}
+
+	/**
+	* Mayor paso (potencia de 2) con el que el error de la rejilla (ver errorPaso) no pasa de tolerancia
+	*/
+	static int pasoPara(const Map &m, float tolerancia){
+		int paso = 1;
+		while (2 * paso < m.getSize() && errorPaso(m, 2 * paso) <= tolerancia){
+			paso *= 2;
+		}
+		return paso;
+	}
+
+	/**
+	* Escribe la rejilla con un vertice cada paso casillas como PLY binario, con colores (Map::colorCasilla)
+	*/
+	static bool ply(const Map &m, std::ostream &salida, int paso = 1){
+		const float *map = m.getMapa();
+		int size = m.getSize();
+		int n = lado(m, paso);
+		salida << "ply\nformat binary_little_endian 1.0\ncomment MapGen-SFML semilla " << m.getSeed()
+			<< "\nelement vertex " << (sf::Uint64)n * n
+			<< "\nproperty float x\nproperty float y\nproperty float z"
+			<< "\nproperty uchar red\nproperty uchar green\nproperty uchar blue"
+			<< "\nelement face " << 2 * (sf::Uint64)(n - 1) * (n - 1)
+			<< "\nproperty list uchar uint vertex_indices\nend_header\n";
+		bool bien = escribePorLotes(salida, n, [&](int J, std::string &s){
+			s.reserve(15 * n);
+			for (int I = 0; I < n; ++I){
+				int x = I * paso, y = J * paso;
+				binario(s, (float)x);
+				binario(s, (float)y);
+				binario(s, map[x + size * y]);
+				sf::Color c = m.colorCasilla(x, y);
+				binario(s, c.r);
+				binario(s, c.g);
+				binario(s, c.b);
+			}
+		});
+		return bien && escribePorLotes(salida, n - 1, [&](int J, std::string &s){
+			s.reserve(2 * 13 * (n - 1));
+			triangulosFila(n, J, [&](sf::Uint32 a, sf::Uint32 b, sf::Uint32 c){
+				binario(s, (sf::Uint8)3);
+				binario(s, a);
+				binario(s, b);
+				binario(s, c);
+			});
+		});
+	}
+
+	/**
+	* Escribe la rejilla con un vertice cada paso casillas como OBJ
+	*/
+	static bool obj(const Map &m, std::ostream &salida, int paso = 1){
+		const float *map = m.getMapa();
+		int size = m.getSize();
+		int n = lado(m, paso);
+		salida << "# MapGen-SFML semilla " << m.getSeed() << "\n";
+		bool bien = escribePorLotes(salida, n, [&](int J, std::string &s){
+			for (int I = 0; I < n; ++I){
+				int x = I * paso, y = J * paso;
+				s += "v ";
+				entero(s, x);
+				s += ' ';
+				entero(s, y);
+				s += ' ';
+				numero(s, map[x + size * y]);
+				s += '\n';
+			}
+		});
+		return bien && escribePorLotes(salida, n - 1, [&](int J, std::string &s){
+			triangulosFila(n, J, [&](sf::Uint32 a, sf::Uint32 b, sf::Uint32 c){
+				// En OBJ los indices empiezan en 1
+				s += "f ";
+				entero(s, a + 1);
+				s += ' ';
+				entero(s, b + 1);
+				s += ' ';
+				entero(s, c + 1);
+				s += '\n';
+			});
+		});
+	}
+
+	/**
+	* Escribe como PLY binario una malla cualquiera del mapa, como la de Triangulacion: puntos (x, y, altura) y tres
+	* indices por triangulo. Los colores son los de las casillas de los puntos
+	*/
+	static bool ply(const Map &m, const std::vector<sf::Vector3f> &puntos, const std::vector<sf::Uint32> &triangulos,
+		std::ostream &salida){
+		int nPuntos = (int)puntos.size(), nTriangulos = (int)(triangulos.size() / 3);
+		salida << "ply\nformat binary_little_endian 1.0\ncomment MapGen-SFML semilla " << m.getSeed()
+			<< "\nelement vertex " << nPuntos
+			<< "\nproperty float x\nproperty float y\nproperty float z"
+			<< "\nproperty uchar red\nproperty uchar green\nproperty uchar blue"
+			<< "\nelement face " << nTriangulos
+			<< "\nproperty list uchar uint vertex_indices\nend_header\n";
+		bool bien = escribePorLotes(salida, (nPuntos + ELEMENTOS_POR_TROZO - 1) / ELEMENTOS_POR_TROZO, [&](int t, std::string &s){
+			int fin = (std::min)(nPuntos, (t + 1) * ELEMENTOS_POR_TROZO);
+			for (int k = t * ELEMENTOS_POR_TROZO; k < fin; ++k){
+				const sf::Vector3f &p = puntos[k];
+				binario(s, p.x);
+				binario(s, p.y);
+				binario(s, p.z);
+				sf::Color c = m.colorCasilla((int)p.x, (int)p.y);
+				binario(s, c.r);
+				binario(s, c.g);
+				binario(s, c.b);
+			}
+		});
+		return bien && escribePorLotes(salida, (nTriangulos + ELEMENTOS_POR_TROZO - 1) / ELEMENTOS_POR_TROZO, [&](int t, std::string &s){
+			int fin = (std::min)(nTriangulos, (t + 1) * ELEMENTOS_POR_TROZO);
+			for (int k = t * ELEMENTOS_POR_TROZO; k < fin; ++k){
+				binario(s, (sf::Uint8)3);
+				binario(s, triangulos[3 * k]);
+				binario(s, triangulos[3 * k + 1]);
+				binario(s, triangulos[3 * k + 2]);
+			}
+		});
+	}
+
+	/**
+	* Escribe como OBJ una malla cualquiera del mapa (ver el ply de mallas)
+	*/
+	static bool obj(const Map &m, const std::vector<sf::Vector3f> &puntos, const std::vector<sf::Uint32> &triangulos,
+		std::ostream &salida){
+		int nPuntos = (int)puntos.size(), nTriangulos = (int)(triangulos.size() / 3);
+		salida << "# MapGen-SFML semilla " << m.getSeed() << "\n";
+		bool bien = escribePorLotes(salida, (nPuntos + ELEMENTOS_POR_TROZO - 1) / ELEMENTOS_POR_TROZO, [&](int t, std::string &s){
+			int fin = (std::min)(nPuntos, (t + 1) * ELEMENTOS_POR_TROZO);
+			for (int k = t * ELEMENTOS_POR_TROZO; k < fin; ++k){
+				s += "v ";
+				numero(s, puntos[k].x);
+				s += ' ';
+				numero(s, puntos[k].y);
+				s += ' ';
+				numero(s, puntos[k].z);
+				s += '\n';
+			}
+		});
+		return bien && escribePorLotes(salida, (nTriangulos + ELEMENTOS_POR_TROZO - 1) / ELEMENTOS_POR_TROZO, [&](int t, std::string &s){
+			int fin = (std::min)(nTriangulos, (t + 1) * ELEMENTOS_POR_TROZO);
+			for (int k = t * ELEMENTOS_POR_TROZO; k < fin; ++k){
+				s += "f ";
+				entero(s, triangulos[3 * k] + 1);
+				s += ' ';
+				entero(s, triangulos[3 * k + 1] + 1);
+				s += ' ';
+				entero(s, triangulos[3 * k + 2] + 1);
+				s += '\n';
+			}
+		});
+	}
+
+	/**
+	* Escribe el mapa como PLY en ruta. Con tolerancia > 0 se simplifica (ver pasoPara)
+	*/
+	static bool ply(const Map &m, const std::string &ruta, float tolerancia = 0){
+		std::ofstream f;
+		return abre(f, ruta) && ply(m, f, (tolerancia > 0) ? pasoPara(m, tolerancia) : 1);
+	}
+
+	/**
+	* Escribe el mapa como OBJ en ruta. Con tolerancia > 0 se simplifica (ver pasoPara)
+	*/
+	static bool obj(const Map &m, const std::string &ruta, float tolerancia = 0){
+		std::ofstream f;
+		return abre(f, ruta) && obj(m, f, (tolerancia > 0) ? pasoPara(m, tolerancia) : 1);
+	}
+};
+
+#endif
@@ -0,0 +1,228 @@
+#ifndef HISTORIAL_HPP
+#define HISTORIAL_HPP
+
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include "Map.hpp"
+#include "CodecAlturas.hpp"
+
+/*
+* Historial de cambios de un mapa para deshacer y rehacer ediciones (modificaSector, pinceles...).
+* De cada cambio solo se guarda el rectangulo que toca, como estaba antes y como queda despues, comprimido con
+* CodecAlturas: editar un sector pequeno de un mapa enorme ocupa unos pocos KB en vez de una copia del mapa.
+*
+* El historial no pasa de una memoria maxima. Cuando se pasa, los dos cambios mas antiguos se juntan en uno si el
+* rectangulo de uno contiene al del otro (lo normal al retocar una zona varias veces), que ocupa menos que los dos;
+* si no, el mas antiguo se olvida
+*/
+class Historial {
+private:
+
+	struct Cambio {
+		int x0, y0, ancho, alto;
+		std::vector<sf::Uint8> antes, despues;
+
+		size_t memoria() const{
+			return sizeof(Cambio) + antes.capacity() + despues.capacity();
+		}
+
+		bool contiene(const Cambio &c) const{
+			return c.x0 >= x0 && c.y0 >= y0 && c.x0 + c.ancho <= x0 + ancho && c.y0 + c.alto <= y0 + alto;
+		}
+	};
+
+	Map &mapa;
+	size_t memoriaMaxima;
+	size_t memoria;
+	std::deque<Cambio> deshacer;	// El ultimo cambio al final
+	std::vector<Cambio> rehacer;	// El ultimo deshecho al final
+	bool abierto;
+	Cambio actual;
+
+	const float *casilla(const Cambio &c) const{
+		return mapa.map + c.x0 + mapa.getSize() * c.y0;
+	}
+
+	/**
+	* Deja el rectangulo del cambio como estaba antes o despues de hacerlo
+	*/
+	void aplica(const Cambio &c, const std::vector<sf::Uint8> &datos, sf::IntRect *region){
+		CodecAlturas::decodificaRectangulo(&datos[0], datos.size(), mapa.map + c.x0 + mapa.getSize() * c.y0,
+			mapa.getSize(), c.ancho, c.alto);
+		mapa.actualizaRegion(c.x0, c.y0, c.x0 + c.ancho - 1, c.y0 + c.alto - 1);
+		if (region != nullptr){
+			*region = sf::IntRect(c.x0, c.y0, c.ancho, c.alto);
+		}
+	}
+
+	/**
+	* Pone encima de los datos del rectangulo de c (comprimidos) los del rectangulo de dentro, que esta contenido en el
+	*/
+	static void superpone(const Cambio &c, std::vector<sf::Uint8> &datos, const Cambio &dentro, const std::vector<sf::Uint8> &datosDentro){
+		std::vector<float> alturas((size_t)c.ancho * c.alto);
+		CodecAlturas::decodificaRectangulo(&datos[0], datos.size(), &alturas[0], c.ancho, c.ancho, c.alto);
+		CodecAlturas::decodificaRectangulo(&datosDentro[0], datosDentro.size(),
+			&alturas[(dentro.x0 - c.x0) + c.ancho * (dentro.y0 - c.y0)], c.ancho, dentro.ancho, dentro.alto);
+		CodecAlturas::codificaRectangulo(&alturas[0], c.ancho, c.ancho, c.alto, datos);
+	}
+
+	/**
+	* Junta en el los dos cambios mas antiguos, o olvida el mas antiguo si no se pueden juntar
+	*/
+	void recortaUno(){
+		Cambio &a = deshacer[0];
+		if (deshacer.size() >= 2){
+			Cambio &b = deshacer[1];
+			if (a.contiene(b) || b.contiene(a)){
+				memoria -= a.memoria() + b.memoria();
+				if (a.contiene(b)){
+					// Antes: el de a. Despues: el de a con lo que cambio b encima
+					superpone(a, a.despues, b, b.despues);
+					b.x0 = a.x0; b.y0 = a.y0; b.ancho = a.ancho; b.alto = a.alto;
+					b.despues.swap(a.despues);
+					b.antes.swap(a.antes);
+				}
+				else{
+					// Antes: el de b con lo que habia antes de a encima. Despues: el de b
+					superpone(b, b.antes, a, a.antes);
+				}
+				b.antes.shrink_to_fit();
+				b.despues.shrink_to_fit();
+				memoria += b.memoria();
+				deshacer.pop_front();
+				return;
+			}
+		}
+		memoria -= a.memoria();
+		deshacer.pop_front();
+	}
+
+	void recorta(){
+		while (memoria > memoriaMaxima && !deshacer.empty()){
+			recortaUno();
+		}
+	}
+
+	void vaciaRehacer(){
+		for (auto &c : rehacer){
+			memoria -= c.memoria();
+		}
+		rehacer.clear();
+	}
+
+public:
+
+	/**
+	* Historial de mapa que ocupa como mucho memoriaMaxima bytes
+	*/
+	Historial(Map &mapa, size_t memoriaMaxima) :
+		mapa(mapa),
+		memoriaMaxima(memoriaMaxima),
+		memoria(0),
+		abierto(false)
+	{
+	}
+
+	/**
+	* Empieza un cambio que va a tocar (solo) las casillas [x0,x1] x [y0,y1]: guarda como estan ahora
+	*/
+	void comienza(int x0, int y0, int x1, int y1){
+		int size = mapa.getSize();
+		x0 = (std::max)(x0, 0);
+		y0 = (std::max)(y0, 0);
+		x1 = (std::min)(x1, size - 1);
+		y1 = (std::min)(y1, size - 1);
+		abierto = x0 <= x1 && y0 <= y1;
+		if (!abierto) return;
+		actual.x0 = x0;
+		actual.y0 = y0;
+		actual.ancho = x1 - x0 + 1;
+		actual.alto = y1 - y0 + 1;
+		CodecAlturas::codificaRectangulo(casilla(actual), size, actual.ancho, actual.alto, actual.antes);
+	}
+
+	/**
+	* Termina el cambio empezado con comienza(): guarda como ha quedado el rectangulo. Los cambios deshechos ya no se
+	* pueden rehacer
+	*/
+	void termina(){
+		if (!abierto) return;
+		abierto = false;
+		CodecAlturas::codificaRectangulo(casilla(actual), mapa.getSize(), actual.ancho, actual.alto, actual.despues);
+		actual.antes.shrink_to_fit();
+		actual.despues.shrink_to_fit();
+		vaciaRehacer();
+		memoria += actual.memoria();
+		deshacer.push_back(Cambio());
+		deshacer.back().x0 = actual.x0;
+		deshacer.back().y0 = actual.y0;
+		deshacer.back().ancho = actual.ancho;
+		deshacer.back().alto = actual.alto;
+		deshacer.back().antes.swap(actual.antes);
+		deshacer.back().despues.swap(actual.despues);
+		recorta();
+	}
+
+	/**
+	* Hace un cambio con f() guardandolo en el historial: comienza(x0, y0, x1, y1), f() y termina()
+	*/
+	template <class F>
+	void edita(int x0, int y0, int x1, int y1, F f){
+		comienza(x0, y0, x1, y1);
+		f();
+		termina();
+	}
+
+	/**
+	* Deshace el ultimo cambio. Devuelve false si no hay ninguno. Si region no es nullptr deja en ella el rectangulo de
+	* casillas que ha cambiado
+	*/
+	bool deshaz(sf::IntRect *region = nullptr){
+		if (deshacer.empty()) return false;
+		aplica(deshacer.back(), deshacer.back().antes, region);
+		rehacer.push_back(Cambio());
+		std::swap(rehacer.back(), deshacer.back());
+		deshacer.pop_back();
+		return true;
+	}
+
+	/**
+	* Rehace el ultimo cambio deshecho. Devuelve false si no hay ninguno. Si region no es nullptr deja en ella el
+	* rectangulo de casillas que ha cambiado
+	*/
+	bool rehaz(sf::IntRect *region = nullptr){
+		if (rehacer.empty()) return false;
+		aplica(rehacer.back(), rehacer.back().despues, region);
+		deshacer.push_back(Cambio());
+		std::swap(deshacer.back(), rehacer.back());
+		rehacer.pop_back();
+		return true;
+	}
+
+	bool puedeDeshacer() const{
+		return !deshacer.empty();
+	}
+
+	bool puedeRehacer() const{
+		return !rehacer.empty();
+	}
+
+	/**
+	* Memoria que ocupan ahora los cambios guardados
+	*/
+	size_t getMemoria() const{
+		return memoria;
+	}
+
+	/**
+	* Olvida todos los cambios (por ejemplo, al cargar otro mapa)
+	*/
+	void vacia(){
+		deshacer.clear();
+		rehacer.clear();
+		memoria = 0;
+	}
+};
+
+#endif
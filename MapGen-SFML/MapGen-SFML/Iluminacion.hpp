@@ -0,0 +1,385 @@
+#ifndef ILUMINACION_HPP
+#define ILUMINACION_HPP
+
+#include <SFML\Graphics.hpp>
+#include <vector>
+#include <math.h>
+#include <cfloat>
+#include "Paralelo.hpp"
+
+/*
+* Sombreado del relieve (hillshade). Para cada casilla se calcula una vez su normal a partir de las alturas vecinas,
+* y con ella la luz que recibe de un sol en una direccion dada (modelo de Lambert): el coseno del angulo entre la
+* normal y la direccion del sol. Ese factor se multiplica por el color de la casilla.
+*
+* Las normales se guardan en tres arrays separados (x, y, z), de forma que cambiar la direccion del sol es una sola
+* pasada de multiplicaciones y sumas sobre el mapa, sin volver a calcular las normales.
+* Los bucles internos recorren filas completas sin condiciones, para que el compilador los pueda vectorizar.
+*
+* Opcionalmente se calculan tambien sombras arrojadas y oclusion ambiental. Las dos se sacan con barridos: el mapa se
+* recorre por lineas paralelas a una direccion y, a lo largo de cada linea, se mantiene lo que hace falta del terreno ya
+* visto (la altura de sombra para el sol, la pila de horizonte para la oclusion). Cada direccion cuesta O(n) y las
+* lineas son independientes, asi que se reparten entre hilos
+*/
+class Iluminacion {
+private:
+
+	int size;
+	float escalaZ;
+	std::vector<float> nx, ny, nz;
+
+	/*
+	* luz[x + size*y] es el factor (entre ambiente y 1) por el que se multiplica el color de la casilla (x,y)
+	*/
+	std::vector<float> luz;
+
+	/*
+	* Luz minima que recibe una casilla aunque no le de el sol, para que las laderas en sombra no queden negras
+	*/
+	float ambiente;
+
+	float solX, solY, solZ;
+	float azimut, elevacion;
+
+	/*
+	* Mapa de alturas del ultimo calculaNormales, para rehacer las sombras al mover el sol
+	*/
+	const float *mapa;
+
+	/*
+	* sombra[k] es 1 si al centro de la casilla k le da el sol y 0 si lo tapa otra parte del terreno.
+	* oclusion[k] es la fraccion del cielo que se ve desde la casilla (1 en llano abierto, menos en valles)
+	* Si estan vacios no se aplican
+	*/
+	std::vector<float> sombra;
+	std::vector<float> oclusion;
+	int direccionesOclusion;
+
+	/**
+	* Recorre el mapa por lineas rectas en la direccion (tx, ty) y llama a f(indices, paso) para cada linea, con los
+	* indices de sus casillas en el orden en que se avanza y la distancia entre dos casillas seguidas.
+	* Las lineas avanzan una casilla por paso en el eje dominante de la direccion, y en el otro eje lo que toque
+	* redondeado; como el desplazamiento es el mismo para todas, cada casilla cae en una sola linea.
+	* Las lineas se procesan en paralelo
+	*/
+	template <class F>
+	void barrido(float tx, float ty, F f) const{
+		bool ejeX = fabs(tx) >= fabs(ty);
+		float principal = ejeX ? tx : ty;
+		float pendiente = (ejeX ? ty : tx) / principal;
+		bool avanza = principal > 0;
+		float paso = sqrtf(1 + pendiente * pendiente);
+		int max = size - 1;
+		int dFin = (int)floorf(max * pendiente + 0.5f);
+		int kMin = -((dFin > 0) ? dFin : 0);
+		int kMax = max - ((dFin < 0) ? dFin : 0);
+		int n = size;
+		paralelo(kMin, kMax + 1, [&](int k){
+			std::vector<int> indices;
+			indices.reserve(n);
+			for (int t = 0; t <= max; ++t){
+				int p = avanza ? t : max - t;
+				int q = k + (int)floorf(p * pendiente + 0.5f);
+				if (q < 0 || q > max) continue;
+				indices.push_back(ejeX ? p + n * q : q + n * p);
+			}
+			if (!indices.empty()){
+				f(indices, paso);
+			}
+		});
+	}
+
+	/**
+	* Sombras arrojadas con el sol actual. Se avanza en el sentido en que viaja la luz llevando la altura de la sombra
+	* que proyecta lo ya recorrido: en cada paso baja lo que marca la elevacion del sol, y si una casilla queda por
+	* debajo esta en sombra; si no, ella pasa a ser la que proyecta
+	*/
+	void calculaSombras(){
+		sombra.resize(size * size);
+		float caida = tanf(elevacion * 3.14159265359f / 180);
+		float a = azimut * 3.14159265359f / 180;
+		const float *map = mapa;
+		float ez = escalaZ;
+		float *s = &sombra[0];
+		barrido(-cosf(a), -sinf(a), [&](const std::vector<int> &indices, float paso){
+			float baja = caida * paso;
+			float alturaSombra = -FLT_MAX;
+			for (size_t t = 0; t < indices.size(); ++t){
+				int k = indices[t];
+				float h = map[k] * ez;
+				alturaSombra -= baja;
+				if (h < alturaSombra){
+					s[k] = 0;
+				}
+				else{
+					s[k] = 1;
+					alturaSombra = h;
+				}
+			}
+		});
+	}
+
+	/**
+	* Oclusion ambiental por horizontes. Para cada una de las direcciones se busca, desde cada casilla, la pendiente
+	* maxima hacia el terreno que tiene delante en esa direccion, y lo que tapa ese horizonte (su seno) se resta del
+	* cielo visible.
+	* El horizonte se saca con una pila por linea: las casillas ya recorridas que forman la envolvente superior. Una
+	* casilla que queda por debajo de la recta entre la actual y la anterior de la pila no puede ser horizonte de
+	* ninguna casilla posterior, asi que se saca; lo que queda en la cima es el horizonte de la actual. Cada casilla
+	* entra y sale de la pila una vez, por eso la linea cuesta O(longitud)
+	*/
+	void calculaOclusion(){
+		oclusion.assign(size * size, 0);
+		const float *map = mapa;
+		float ez = escalaZ;
+		float *o = &oclusion[0];
+		float peso = 1.0f / direccionesOclusion;
+		for (int d = 0; d < direccionesOclusion; ++d){
+			float a = 2 * 3.14159265359f * d / direccionesOclusion;
+			// Se avanza en sentido contrario al que se mira, para que lo que tapa ya este en la pila
+			barrido(-cosf(a), -sinf(a), [&](const std::vector<int> &indices, float paso){
+				std::vector<sf::Vector2f> pila;
+				pila.reserve(indices.size());
+				for (size_t t = 0; t < indices.size(); ++t){
+					int k = indices[t];
+					sf::Vector2f actual((float)t * paso, map[k] * ez);
+					while (pila.size() >= 2){
+						const sf::Vector2f &cima = pila[pila.size() - 1];
+						const sf::Vector2f &bajo = pila[pila.size() - 2];
+						float haciaCima = (cima.y - actual.y) / (actual.x - cima.x);
+						float haciaBajo = (bajo.y - actual.y) / (actual.x - bajo.x);
+						if (haciaCima > haciaBajo) break;
+						pila.pop_back();
+					}
+					if (!pila.empty()){
+						const sf::Vector2f &cima = pila.back();
+						float pendiente = (cima.y - actual.y) / (actual.x - cima.x);
+						if (pendiente > 0){
+							o[k] += peso * pendiente / sqrtf(1 + pendiente * pendiente);
+						}
+					}
+					pila.push_back(actual);
+				}
+			});
+		}
+		for (int k = 0; k < size * size; ++k){
+			o[k] = 1 - o[k];
+		}
+	}
+
+	/**
+	* Calcula las normales de las filas [y0,y1] con diferencias centrales. En los bordes se usa la diferencia con el
+	* unico vecino que hay
+	*/
+	void normalesFilas(const float *map, int y0, int y1){
+		int max = size - 1;
+		for (int y = y0; y <= y1; ++y){
+			int arriba = (y > 0) ? y - 1 : y;
+			int abajo = (y < max) ? y + 1 : y;
+			const float *fila = map + size * y;
+			const float *filaArriba = map + size * arriba;
+			const float *filaAbajo = map + size * abajo;
+			float *px = &nx[size * y];
+			float *py = &ny[size * y];
+			float *pz = &nz[size * y];
+			float fy = escalaZ / (abajo - arriba);
+			float fx = escalaZ * 0.5f;
+			for (int x = 1; x < max; ++x){
+				float dx = (fila[x + 1] - fila[x - 1]) * fx;
+				float dy = (filaAbajo[x] - filaArriba[x]) * fy;
+				float inv = 1 / sqrtf(dx * dx + dy * dy + 1);
+				px[x] = -dx * inv;
+				py[x] = -dy * inv;
+				pz[x] = inv;
+			}
+			int bordes[2] = { 0, max };
+			for (int b = 0; b < 2; ++b){
+				int x = bordes[b];
+				int izq = (x > 0) ? x - 1 : x;
+				int dcha = (x < max) ? x + 1 : x;
+				float dx = (fila[dcha] - fila[izq]) * escalaZ / (dcha - izq);
+				float dy = (filaAbajo[x] - filaArriba[x]) * fy;
+				float inv = 1 / sqrtf(dx * dx + dy * dy + 1);
+				px[x] = -dx * inv;
+				py[x] = -dy * inv;
+				pz[x] = inv;
+			}
+		}
+	}
+
+	/**
+	* Calcula la luz de las filas [y0,y1] con la direccion del sol actual
+	*/
+	void luzFilas(int y0, int y1){
+		float lx = solX, ly = solY, lz = solZ;
+		float a = ambiente, d = 1 - ambiente;
+		int inicio = size * y0;
+		int fin = size * (y1 + 1);
+		for (int k = inicio; k < fin; ++k){
+			float l = nx[k] * lx + ny[k] * ly + nz[k] * lz;
+			l = (l > 0) ? l : 0;
+			luz[k] = a + d * l;
+		}
+		if (!sombra.empty()){
+			for (int k = inicio; k < fin; ++k){
+				luz[k] = a + (luz[k] - a) * sombra[k];
+			}
+		}
+		if (!oclusion.empty()){
+			for (int k = inicio; k < fin; ++k){
+				luz[k] *= oclusion[k];
+			}
+		}
+	}
+
+	/**
+	* Recalcula la luz de todo el mapa, fila a fila en paralelo
+	*/
+	void luzMapa(){
+		paralelo(0, size, [this](int y){
+			luzFilas(y, y);
+		});
+	}
+
+public:
+
+	Iluminacion() :
+		size(0),
+		escalaZ(1),
+		ambiente(0.35f),
+		solX(0),
+		solY(0),
+		solZ(1),
+		azimut(0),
+		elevacion(90),
+		mapa(nullptr),
+		direccionesOclusion(16)
+	{
+	}
+
+	/**
+	* Calcula y guarda las normales de un mapa de size x size alturas. escalaZ multiplica las alturas antes de calcular
+	* las pendientes (mas de 1 exagera el relieve)
+	*/
+	void calculaNormales(const float *map, int size, float escalaZ = 1){
+		this->size = size;
+		this->escalaZ = escalaZ;
+		mapa = map;
+		nx.resize(size * size);
+		ny.resize(size * size);
+		nz.resize(size * size);
+		luz.resize(size * size);
+		paralelo(0, size, [&](int y){
+			normalesFilas(map, y, y);
+		});
+		if (!sombra.empty()) calculaSombras();
+		if (!oclusion.empty()) calculaOclusion();
+		luzMapa();
+	}
+
+	/**
+	* Vuelve a calcular normales y luz tras cambiar las alturas de las casillas [x0,x1] x [y0,y1]. Las normales de
+	* las filas vecinas tambien cambian, porque usan esas alturas.
+	* Las sombras y la oclusion, si estan activas, pueden cambiar lejos de la region, asi que se rehacen enteras y
+	* devuelve true para avisar de que ha cambiado la luz de todo el mapa
+	*/
+	bool actualizaRegion(const float *map, int x0, int y0, int x1, int y1){
+		if (size == 0) return false;
+		mapa = map;
+		int desde = (y0 > 0) ? y0 - 1 : 0;
+		int hasta = (y1 < size - 1) ? y1 + 1 : size - 1;
+		normalesFilas(map, desde, hasta);
+		if (sombra.empty() && oclusion.empty()){
+			luzFilas(desde, hasta);
+			return false;
+		}
+		if (!sombra.empty()) calculaSombras();
+		if (!oclusion.empty()) calculaOclusion();
+		luzMapa();
+		return true;
+	}
+
+	/**
+	* Las alturas del mapa se han movido a otra direccion sin cambiar (por ejemplo, al dejar de estar proyectadas desde
+	* un archivo): las sombras y la oclusion se calcularan desde ahi
+	*/
+	void cambiaMapa(const float *map){
+		mapa = map;
+	}
+
+	/**
+	* Pone el sol en la direccion dada y recalcula la luz de todo el mapa (una pasada, las normales no cambian).
+	* azimut: grados desde el eje x, en sentido de las y crecientes. elevacion: grados sobre el horizonte
+	*/
+	void setSol(float azimut, float elevacion){
+		this->azimut = azimut;
+		this->elevacion = elevacion;
+		float a = azimut * 3.14159265359f / 180;
+		float e = elevacion * 3.14159265359f / 180;
+		solX = cosf(e) * cosf(a);
+		solY = cosf(e) * sinf(a);
+		solZ = sinf(e);
+		if (size > 0){
+			if (!sombra.empty()) calculaSombras();
+			luzMapa();
+		}
+	}
+
+	/**
+	* Activa o desactiva las sombras arrojadas. Se recalculan cada vez que se mueve el sol
+	*/
+	void setSombras(bool activas){
+		if (activas == !sombra.empty()) return;
+		if (activas && size > 0){
+			calculaSombras();
+		}
+		else{
+			sombra.clear();
+		}
+		if (size > 0) luzMapa();
+	}
+
+	bool getSombras() const{
+		return !sombra.empty();
+	}
+
+	/**
+	* Activa o desactiva la oclusion ambiental, muestreando el horizonte en el numero de direcciones dado.
+	* No depende del sol, solo se recalcula si cambian las alturas
+	*/
+	void setOclusion(bool activa, int direcciones = 16){
+		direccionesOclusion = (direcciones > 0) ? direcciones : 1;
+		if (activa && size > 0){
+			calculaOclusion();
+		}
+		else{
+			oclusion.clear();
+		}
+		if (size > 0) luzMapa();
+	}
+
+	bool getOclusion() const{
+		return !oclusion.empty();
+	}
+
+	void setAmbiente(float a){
+		ambiente = a;
+	}
+
+	bool calculada() const{
+		return size > 0;
+	}
+
+	float getLuz(int x, int y) const{
+		return luz[x + size * y];
+	}
+
+	/**
+	* Multiplica un color por un factor de luz
+	*/
+	static sf::Color modula(sf::Color c, float f){
+		return sf::Color((sf::Uint8)(c.r * f), (sf::Uint8)(c.g * f), (sf::Uint8)(c.b * f), c.a);
+	}
+};
+
+#endif
@@ -0,0 +1,282 @@
+#ifndef IMPORTADOR_HPP
+#define IMPORTADOR_HPP
+
+#include <SFML\Graphics.hpp>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <cfloat>
+#include "Map.hpp"
+#include "Png.hpp"
+#include "Paralelo.hpp"
+
+/*
+* Carga mapas de alturas hechos fuera (modelos de elevacion reales, otros generadores...) como un Map normal, para
+* dibujarlos y analizarlos igual que los generados. Se admiten:
+*
+*	- PNG en gris de 8 o 16 bits.
+*	- PGM binario (P5) de 8 o 16 bits.
+*	- Alturas float sin cabecera (little-endian, fila a fila): tiene que ser cuadrado, el lado sale del tamano.
+*
+* El archivo se lee una sola vez y fila a fila: cada fila se remuestrea (bilineal) al tamano del Map, 2^n + 1, en
+* cuanto llega, y a la vez se calcula la altura minima y maxima. Al final las alturas se llevan al rango 0 a 255 que
+* usa el resto del programa (colores, agua, cortes), sin redondear. Si la imagen no es cuadrada se estira
+*/
+class Importador {
+public:
+
+	/*
+	* Datos del archivo original
+	*/
+	struct Origen {
+		int ancho;
+		int alto;
+		float alturaMin;
+		float alturaMax;
+	};
+
+private:
+
+	/*
+	* Remuestrea al vuelo las filas de una imagen de ancho x alto a size x size: cada fila de destino sale en cuanto
+	* han llegado las dos filas de origen entre las que cae
+	*/
+	class Remuestreo {
+	private:
+		int ancho, alto, size;
+		float *destino;
+		std::vector<int> columna;		// Columna de origen a la izquierda de cada columna de destino
+		std::vector<float> peso;		// Peso de la columna de la derecha
+		std::vector<float> anterior, actual;
+		int filasLeidas;
+		int siguiente;					// Siguiente fila de destino
+
+		/**
+		* Posicion en el origen (de lado n) de la casilla i del destino
+		*/
+		double posicion(int i, int n) const{
+			return (size > 1) ? (double)i * (n - 1) / (size - 1) : 0;
+		}
+
+		void remuestreaFila(const std::vector<float> &f, std::vector<float> &salida) const{
+			salida.resize(size);
+			for (int x = 0; x < size; ++x){
+				int c = columna[x];
+				float p = peso[x];
+				salida[x] = (p > 0) ? f[c] + (f[c + 1] - f[c]) * p : f[c];
+			}
+		}
+
+	public:
+		float minimo, maximo;
+
+		Remuestreo(int ancho, int alto, int size, float *destino) :
+			ancho(ancho), alto(alto), size(size), destino(destino),
+			columna(size), peso(size),
+			filasLeidas(0), siguiente(0),
+			minimo(FLT_MAX), maximo(-FLT_MAX)
+		{
+			for (int x = 0; x < size; ++x){
+				double u = posicion(x, ancho);
+				columna[x] = (std::min)((int)u, ancho - 1);
+				peso[x] = (float)(u - columna[x]);
+			}
+		}
+
+		/**
+		* Recibe la siguiente fila del origen (ancho alturas) y escribe las filas de destino que ya se pueden calcular
+		*/
+		void fila(const std::vector<float> &f){
+			anterior.swap(actual);
+			remuestreaFila(f, actual);
+			int y = filasLeidas++;
+			while (siguiente < size){
+				double v = posicion(siguiente, alto);
+				if (v > y) break;
+				float t = (float)(v - (y - 1));
+				float *salida = destino + size * siguiente;
+				for (int x = 0; x < size; ++x){
+					float h = (y == 0 || t >= 1) ? actual[x] : anterior[x] + (actual[x] - anterior[x]) * t;
+					salida[x] = h;
+					if (h < minimo) minimo = h;
+					if (h > maximo) maximo = h;
+				}
+				++siguiente;
+			}
+		}
+
+		bool completo() const{
+			return siguiente == size;
+		}
+	};
+
+	/**
+	* Lee un numero de la cabecera de un PGM, saltando espacios y comentarios
+	*/
+	static int numeroPgm(std::istream &f){
+		for (;;){
+			int c = f.peek();
+			if (c == '#'){
+				std::string comentario;
+				std::getline(f, comentario);
+			}
+			else if (c == ' ' || c == '\t' || c == '\r' || c == '\n'){
+				f.get();
+			}
+			else{
+				break;
+			}
+		}
+		int n = -1;
+		f >> n;
+		return n;
+	}
+
+	/**
+	* Detalle con el que se importa una imagen de ancho x alto: el menor que no pierde resolucion (como mucho 13)
+	*/
+	static int detalleAdecuado(int ancho, int alto){
+		int lado = (std::max)(ancho, alto);
+		int detalle = 1;
+		while (detalle < 13 && (1 << detalle) + 1 < lado) ++detalle;
+		return detalle;
+	}
+
+	/**
+	* Lee las filas del archivo ya abierto y colocado al principio de las alturas. leeFila(fila) deja en fila las
+	* alturas de la siguiente fila y devuelve false si hay un error
+	*/
+	template <class LeeFila>
+	static Map *lee(const std::string &ruta, int ancho, int alto, int detalle, Origen *origen, LeeFila leeFila){
+		if (ancho < 2 || alto < 2){
+			std::cout << ruta << ": imagen demasiado pequena" << std::endl;
+			return nullptr;
+		}
+		if (detalle <= 0){
+			detalle = detalleAdecuado(ancho, alto);
+		}
+		int size = (1 << detalle) + 1;
+		float *alturas = new float[(size_t)size * size];
+		Remuestreo remuestreo(ancho, alto, size, alturas);
+		std::vector<float> fila(ancho);
+		float minimo = FLT_MAX, maximo = -FLT_MAX;
+		for (int y = 0; y < alto; ++y){
+			if (!leeFila(fila)){
+				std::cout << ruta << ": error al leer la fila " << y << std::endl;
+				delete[] alturas;
+				return nullptr;
+			}
+			for (int x = 0; x < ancho; ++x){
+				if (fila[x] < minimo) minimo = fila[x];
+				if (fila[x] > maximo) maximo = fila[x];
+			}
+			remuestreo.fila(fila);
+		}
+		if (origen != nullptr){
+			origen->ancho = ancho;
+			origen->alto = alto;
+			origen->alturaMin = minimo;
+			origen->alturaMax = maximo;
+		}
+
+		// Al rango 0 a 255, el que tienen los mapas generados despues de normalize()
+		float base = remuestreo.minimo;
+		float escala = (remuestreo.maximo > base) ? 255 / (remuestreo.maximo - base) : 0;
+		paralelo(0, size, [&](int y){
+			float *f = alturas + (size_t)size * y;
+			for (int x = 0; x < size; ++x){
+				f[x] = (f[x] - base) * escala;
+			}
+		});
+		Map *m = new Map(detalle, 0, 0, alturas);
+		m->minHeight = 0;
+		m->maxHeight = (escala > 0) ? 255 : 0;
+		m->inicializaDibujo();
+		return m;
+	}
+
+	static Map *png(std::ifstream &f, const std::string &ruta, int detalle, Origen *origen){
+		LectorPng png(f);
+		if (!png.abre()){
+			std::cout << ruta << ": PNG no valido" << std::endl;
+			return nullptr;
+		}
+		if (png.getTipo() != 0 || (png.getProfundidad() != 8 && png.getProfundidad() != 16)){
+			std::cout << ruta << ": solo se admiten PNG en gris de 8 o 16 bits" << std::endl;
+			return nullptr;
+		}
+		bool dieciseis = png.getProfundidad() == 16;
+		std::vector<sf::Uint8> datos;
+		return lee(ruta, png.getAncho(), png.getAlto(), detalle, origen, [&](std::vector<float> &fila){
+			if (!png.fila(datos)) return false;
+			for (size_t x = 0; x < fila.size(); ++x){
+				fila[x] = dieciseis ? (float)((datos[2 * x] << 8) | datos[2 * x + 1]) : (float)datos[x];
+			}
+			return true;
+		});
+	}
+
+	static Map *pgm(std::ifstream &f, const std::string &ruta, int detalle, Origen *origen){
+		f.seekg(2);
+		int ancho = numeroPgm(f), alto = numeroPgm(f), maximo = numeroPgm(f);
+		if (ancho <= 0 || alto <= 0 || maximo <= 0 || maximo > 65535 || !f){
+			std::cout << ruta << ": cabecera PGM incorrecta" << std::endl;
+			return nullptr;
+		}
+		f.get();	// Un espacio separa la cabecera de los datos
+		int bytes = (maximo > 255) ? 2 : 1;
+		std::vector<sf::Uint8> datos((size_t)ancho * bytes);
+		return lee(ruta, ancho, alto, detalle, origen, [&](std::vector<float> &fila){
+			if (!f.read((char*)&datos[0], datos.size())) return false;
+			for (size_t x = 0; x < fila.size(); ++x){
+				fila[x] = (bytes == 2) ? (float)((datos[2 * x] << 8) | datos[2 * x + 1]) : (float)datos[x];
+			}
+			return true;
+		});
+	}
+
+	static Map *raw(std::ifstream &f, const std::string &ruta, int detalle, Origen *origen){
+		f.seekg(0, std::ios::end);
+		sf::Int64 tam = f.tellg();
+		f.seekg(0);
+		int lado = (int)(sqrt((double)(tam / 4)) + 0.5);
+		if ((sf::Int64)lado * lado * 4 != tam){
+			std::cout << ruta << ": formato desconocido (si son floats sin cabecera, el mapa tiene que ser cuadrado)" << std::endl;
+			return nullptr;
+		}
+		return lee(ruta, lado, lado, detalle, origen, [&](std::vector<float> &fila){
+			return !!f.read((char*)&fila[0], fila.size() * sizeof(float));
+		});
+	}
+
+public:
+
+	/**
+	* Importa un mapa de alturas, listo para dibujar. El formato se reconoce por el contenido. Si detalle es 0 se
+	* elige el menor que conserva la resolucion del archivo (hasta 13); si no, se remuestrea a ese detalle.
+	* Si origen no es nullptr se rellena con el tamano y el rango de alturas del archivo.
+	* Devuelve nullptr si no se puede leer. El mapa devuelto es del llamante
+	*/
+	static Map *importa(const std::string &ruta, int detalle = 0, Origen *origen = nullptr){
+		std::ifstream f(ruta.c_str(), std::ios::binary);
+		if (!f){
+			std::cout << ruta << ": no se puede abrir" << std::endl;
+			return nullptr;
+		}
+		char marca[2] = { 0, 0 };
+		f.read(marca, 2);
+		f.clear();
+		f.seekg(0);
+		if ((sf::Uint8)marca[0] == 137 && marca[1] == 'P'){
+			return png(f, ruta, detalle, origen);
+		}
+		if (marca[0] == 'P' && marca[1] == '5'){
+			return pgm(f, ruta, detalle, origen);
+		}
+		return raw(f, ruta, detalle, origen);
+	}
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef MALLA_HPP
+#define MALLA_HPP
+
+#include <SFML\Graphics.hpp>
+#include <SFML\OpenGL.hpp>
+#include <vector>
+#include <algorithm>
+#include "Map.hpp"
+
+/*
+* Malla de triangulos con los vertices compartidos. A diferencia de Map, que dibuja dos vertices sueltos (una linea)
+* por casilla, aqui cada casilla es un solo vertice y los triangulos se forman con una lista de indices, asi que la
+* superficie es continua y cada punto se proyecta una sola vez.
+*
+* Los puntos se guardan en coordenadas del mapa (x, y, altura), para poder exportarlos, y aparte se guardan proyectados
+* para dibujarlos. Los indices pueden ser una tira de triangulos (GL_TRIANGLE_STRIP, la que sale de una rejilla) o una
+* lista de triangulos sueltos (tres indices por triangulo)
+*/
+class Malla : public sf::Drawable {
+private:
+
+	std::vector<sf::Vector3f> puntos;
+	std::vector<sf::Color> colores;
+	std::vector<sf::Uint32> indices;
+	bool tira;
+
+	/*
+	* Vertices proyectados con el giro y la perspectiva del mapa. invertida indica si el orden de los indices esta dado
+	* la vuelta, que es como Map dibuja cuando el angulo pasa de 180 grados
+	*/
+	std::vector<sf::Vertex> proyectados;
+	bool invertida;
+
+public:
+
+	Malla() :
+		tira(false),
+		invertida(false)
+	{
+	}
+
+	/**
+	* Construye la rejilla de triangulos del mapa, tomando una muestra cada paso casillas (paso es una potencia de 2,
+	* paso 1 es el mapa completo). El vertice (I,J) es el punto I + lado*J, igual que en Map::map.
+	*
+	* Los indices forman una tira que recorre la rejilla por filas de I constante (el mismo orden en el que Map dibuja
+	* sus lineas): para cada par de filas alterna un vertice de cada una, y entre un par y el siguiente repite el ultimo
+	* y el primer vertice para crear triangulos degenerados (sin area) que las unen
+	*/
+	void construye(const Map &mapa, int paso = 1){
+		int lado = (mapa.getSize() - 1) / paso + 1;
+		const float *map = mapa.getMapa();
+		int size = mapa.getSize();
+		puntos.resize(lado * lado);
+		colores.resize(lado * lado);
+		for (int J = 0; J < lado; ++J){
+			for (int I = 0; I < lado; ++I){
+				float h = map[I * paso + size * J * paso];
+				puntos[I + lado * J] = sf::Vector3f(I * paso, J * paso, h);
+				colores[I + lado * J] = mapa.colorCasilla(I * paso, J * paso);
+			}
+		}
+
+		tira = true;
+		indices.clear();
+		indices.reserve(2 * lado * (lado - 1) + 2 * (lado - 2));
+		for (int I = 0; I + 1 < lado; ++I){
+			if (I > 0){
+				indices.push_back(I + lado * (lado - 1));	// ultimo del par anterior (repetido)
+				indices.push_back(I);						// primero de este par (repetido)
+			}
+			for (int J = 0; J < lado; ++J){
+				indices.push_back(I + lado * J);
+				indices.push_back(I + 1 + lado * J);
+			}
+		}
+		invertida = false;
+		proyecta(mapa);
+	}
+
+	/**
+	* Sustituye la malla por los puntos y la lista de triangulos (tres indices cada uno) dados
+	*/
+	void construye(const Map &mapa, const std::vector<sf::Vector3f> &p, const std::vector<sf::Uint32> &triangulos){
+		puntos = p;
+		colores.resize(puntos.size());
+		for (size_t k = 0; k < puntos.size(); ++k){
+			colores[k] = mapa.colorCasilla(puntos[k].x, puntos[k].y);
+		}
+		indices = triangulos;
+		tira = false;
+		invertida = false;
+		proyecta(mapa);
+	}
+
+	/**
+	* Vuelve a proyectar los puntos con el giro actual del mapa. Hay que llamarlo despues de girar el mapa
+	*/
+	void proyecta(const Map &mapa){
+		proyectados.resize(puntos.size());
+		for (size_t k = 0; k < puntos.size(); ++k){
+			proyectados[k].color = colores[k];
+		}
+		if (!puntos.empty()){
+			mapa.proyecta(&puntos[0], puntos.size(), &proyectados[0]);
+		}
+		bool invertir = mapa.getAngle() > 180;
+		if (invertir != invertida){
+			// Dar la vuelta a una tira o a una lista de triangulos deja los mismos triangulos en orden inverso
+			std::reverse(indices.begin(), indices.end());
+			invertida = invertir;
+		}
+	}
+
+	const std::vector<sf::Vector3f>& getPuntos() const{
+		return puntos;
+	}
+
+	const std::vector<sf::Color>& getColores() const{
+		return colores;
+	}
+
+	/**
+	* Devuelve los triangulos de la malla como lista de indices, tres por triangulo (los de una tira se separan y se
+	* descartan los degenerados)
+	*/
+	std::vector<sf::Uint32> getTriangulos() const{
+		if (!tira) return indices;
+		std::vector<sf::Uint32> ret;
+		ret.reserve(3 * indices.size());
+		for (size_t k = 2; k < indices.size(); ++k){
+			sf::Uint32 a = indices[k - 2], b = indices[k - 1], c = indices[k];
+			if (a == b || b == c || a == c) continue;
+			// En una tira los triangulos impares van en sentido contrario; se corrige para mantener la orientacion
+			if (k % 2 == 0){
+				ret.push_back(a); ret.push_back(b); ret.push_back(c);
+			}
+			else{
+				ret.push_back(b); ret.push_back(a); ret.push_back(c);
+			}
+		}
+		return ret;
+	}
+
+	/**
+	* Dibuja la malla con indices directamente con OpenGL, ya que sf::VertexArray no tiene indices.
+	* pushGLStates() deja puesta la vista activa del target; solo falta la transformacion, quitar las texturas y
+	* apuntar los arrays de OpenGL a los sf::Vertex proyectados
+	*/
+	virtual void draw(sf::RenderTarget &target, sf::RenderStates states) const{
+		if (indices.empty()) return;
+		target.pushGLStates();
+		glMatrixMode(GL_MODELVIEW);
+		glLoadMatrixf(states.transform.getMatrix());
+		glDisable(GL_TEXTURE_2D);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_COLOR_ARRAY);
+		const char *datos = reinterpret_cast<const char*>(&proyectados[0]);
+		glVertexPointer(2, GL_FLOAT, sizeof(sf::Vertex), datos);
+		glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(sf::Vertex), datos + 8);
+		glDrawElements(tira ? GL_TRIANGLE_STRIP : GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, &indices[0]);
+		target.popGLStates();
+	}
+};
+
+#endif
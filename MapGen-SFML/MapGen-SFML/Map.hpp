@@ -5,12 +5,43 @@
 #include <iostream>
 #include <iomanip>
 #include <set>
+#include <vector>
+#include <algorithm>
+#include <cfloat>
 #include <hash_map>
 #include <math.h>
+#include <string.h>
 #include <time.h>
 #include <Windows.h>
+#include "Iluminacion.hpp"
+
+class Map;
+
+/*
+* Sitio donde se guardan mapas ya generados para no tener que volver a generarlos (ver CacheMapas).
+* Map::generate lo consulta antes de generar y le pasa lo que genera
+*/
+class AlmacenMapas {
+public:
+	virtual ~AlmacenMapas(){}
+
+	/**
+	* Si tiene el mapa generado con esos parametros copia sus size x size alturas en alturas y devuelve true
+	*/
+	virtual bool busca(int detalle, int semilla, float roughness, float *alturas, int size) = 0;
+
+	/**
+	* Guarda un mapa recien generado
+	*/
+	virtual void guarda(const Map &mapa) = 0;
+};
 
 class Map : public sf::Drawable, sf::Transformable {
+	friend class ArchivoMapa;
+	friend class Importador;
+	friend class Historial;
+	friend class PublicadorMapa;
+	friend class LectorMapa;
 private:
 
 	// ATRIBUTOS DE LA LOGICA DEL MAPA
@@ -48,7 +79,65 @@ private:
 	int minHeight;
 
 	int peekHeight;
-	sf::VertexArray va;
+
+	/*
+	* El mapa se dibuja por trozos de LADO_TROZO x LADO_TROZO casillas. Cada trozo tiene sus propios vertices, el
+	* rectangulo que ocupa en pantalla y una marca de sucio, de forma que un cambio (girar, editar un sector, cambiar
+	* la altura del agua...) solo obliga a recalcular los trozos afectados, y draw() solo dibuja (y recalcula) los
+	* trozos que se ven. Por eso los trozos son mutable, se recalculan bajo demanda desde draw()
+	*/
+	/*
+	* Rango de vertices de un trozo que se dibuja de una vez, de quads o de lineas (va)
+	*/
+	struct Tramo {
+		bool quads;
+		size_t inicio;
+		size_t cuenta;
+	};
+
+	/*
+	* Minimo de muestras seguidas iguales para juntarlas en un quad (4 vertices) en lugar de dibujar una linea
+	* (2 vertices) por muestra
+	*/
+	static const int TIRA_MINIMA = 3;
+
+	struct Trozo {
+		int i0, j0;					// primera casilla del trozo
+		float alturaMin, alturaMax;
+		sf::FloatRect limites;		// rectangulo que ocupa en pantalla (sin zoom)
+		float pasoCelda;			// distancia en pantalla entre dos casillas vecinas del centro del trozo
+		int nivel;					// nivel de detalle con el que se calcularon los vertices
+		bool sucio;
+		sf::VertexArray va;			// lineas sueltas
+		sf::VertexArray quads;		// tiras de casillas iguales (ver calculateVertex)
+		std::vector<Tramo> tramos;	// orden en el que se dibujan va y quads
+	};
+	static const int LADO_TROZO = 64;
+	mutable std::vector<Trozo> trozos;
+	int trozosPorLado;
+
+	/*
+	* Niveles de detalle (LOD). El nivel k dibuja una sola linea por cada grupo de 2^k x 2^k casillas, usando la altura
+	* maxima del grupo para que no desaparezcan las cimas al alejarse. Como mucho un grupo ocupa un trozo entero.
+	* maximos[k-1] guarda, para el nivel k, la altura maxima de cada grupo (el nivel 0 es el propio mapa). Cada nivel se
+	* obtiene del anterior con el maximo de 4 valores
+	*/
+	std::vector<std::vector<float> > maximos;
+	int numNiveles;
+
+	/*
+	* En modo horizonte el mapa se recorre de delante hacia atras guardando, para cada columna de pantalla, la parte
+	* mas alta ya tapada por el terreno cercano (el horizonte). Las lineas que quedan por debajo no se generan y las
+	* que quedan tapadas en parte se recortan, asi no hay lineas que se pinten encima de otras
+	*/
+	bool modoHorizonte;
+
+	/*
+	* Si sombreado es true, el color de cada casilla se multiplica por la luz que le da el sol (ver Iluminacion)
+	*/
+	Iluminacion iluminacion;
+	bool sombreado;
+
 	float angle;
 	int altoMapa;
 	int alturaAgua;
@@ -255,7 +344,7 @@ private:
 	return color;
 	}*/
 
-	sf::Color calculaColorAgua(int altura){
+	sf::Color calculaColorAgua(int altura) const{
 		int alto = 255 - altura;
 		sf::Color color;
 		int valorA, valorB;
@@ -274,7 +363,7 @@ private:
 	/**
 	* Devuelve el color correspondiente a un valor de altura (representativo, entre 0-altoMapa)
 	*/
-	sf::Color calculaColor(int altura){
+	sf::Color calculaColor(int altura) const{
 		int alto = 255 - altura;
 		sf::Color color;
 		int offset = (alto * 128 / altoMapa);
@@ -387,60 +476,415 @@ private:
 		return sf::Vector2f((x0 + px / py), (y0 + pz / py));
 	}
 
-	void calculateVertex(){
-		va.clear();
+	/**
+	* Ajusta el rectangulo r para que contenga el punto p
+	*/
+	static void amplia(sf::FloatRect &r, sf::Vector2f p){
+		float dcha = (std::max)(r.left + r.width, p.x);
+		float abajo = (std::max)(r.top + r.height, p.y);
+		r.left = (std::min)(r.left, p.x);
+		r.top = (std::min)(r.top, p.y);
+		r.width = dcha - r.left;
+		r.height = abajo - r.top;
+	}
+
+	/*
+	* Datos del giro actual del mapa: seno y coseno del angulo y el centro de giro (m,n)
+	*/
+	struct Giro {
+		float seno, coseno;
+		float m, n;
+	};
+
+	Giro giro() const{
 		int initXOff = 50;
-		int initYOff = 50;
-		int margin = 1;
-		int offY = 0;
 		//sf::Vector2f ctr(initXOff + size / 2, initYOff + size / 2);
 		sf::Vector2f ctr = perspective(initXOff + size / 2, initXOff + size / 2, 0);
-		for (size_t i = 0; i < size; ++i){
-			for (size_t j = 0; j < size; ++j){
-				int h = this->get(i, j);
-				sf::Color c = calculaColor(h);
-				if (h < alturaAgua){
-					c = calculaColorAgua(h);
+		float r = (-angle * 3.14159265359) / 180;
+		Giro g;
+		g.seno = std::sin(r);
+		g.coseno = std::cos(r);
+		g.m = ctr.x;
+		g.n = ctr.y;
+		return g;
+	}
+
+	/**
+	* Posicion (x,y) en la que se dibuja la casilla (i,j) una vez aplicado el giro g
+	*/
+	sf::Vector2i gira(const Giro &g, float i, float j) const{
+		int initXOff = 50;
+		int initYOff = 50;
+		int offY = 0;
+		int x = initXOff;
+		x += (g.coseno * (i - g.m) + (j - g.n)*g.seno + g.m);
+		int y = initYOff + offY;
+		y += -g.seno * (i - g.m) + g.coseno*(j - g.n) + g.n;
+		return sf::Vector2i(x, y);
+	}
+
+	/**
+	* Numero de muestras por lado del nivel de detalle k
+	*/
+	int tamNivel(int k) const{
+		int paso = 1 << k;
+		return (size + paso - 1) / paso;
+	}
+
+	/**
+	* Altura de la muestra (I,J) del nivel de detalle k
+	*/
+	float alturaNivel(int k, int I, int J) const{
+		if (k == 0) return get(I, J);
+		return maximos[k - 1][I + tamNivel(k) * J];
+	}
+
+	/**
+	* Recalcula la piramide de maximos de los niveles de detalle para las casillas [x0,x1] x [y0,y1]
+	*/
+	void calculaMaximos(int x0, int y0, int x1, int y1){
+		for (int k = 1; k < numNiveles; ++k){
+			int tam = tamNivel(k);
+			int tamAnt = tamNivel(k - 1);
+			std::vector<float> &nivel = maximos[k - 1];
+			for (int J = y0 >> k; J <= (y1 >> k); ++J){
+				for (int I = x0 >> k; I <= (x1 >> k); ++I){
+					float h = alturaNivel(k - 1, 2 * I, 2 * J);
+					if (2 * I + 1 < tamAnt) h = (std::max)(h, alturaNivel(k - 1, 2 * I + 1, 2 * J));
+					if (2 * J + 1 < tamAnt) h = (std::max)(h, alturaNivel(k - 1, 2 * I, 2 * J + 1));
+					if (2 * I + 1 < tamAnt && 2 * J + 1 < tamAnt) h = (std::max)(h, alturaNivel(k - 1, 2 * I + 1, 2 * J + 1));
+					nivel[I + tam * J] = h;
 				}
+			}
+		}
+	}
 
-				float r = (-angle * 3.14159265359) / 180;
-				float m = ctr.x;
-				float n = ctr.y;
-				int x = initXOff;
-				x += (std::cos(r) * (i - m) + (j - n)*std::sin(r) + m);
+	/**
+	* Ultima casilla (incluida) del trozo en cada eje
+	*/
+	int finTrozo(int inicio) const{
+		return (std::min)(inicio + LADO_TROZO, size) - 1;
+	}
 
-				int y = initYOff + j;
+	/**
+	* Recalcula la altura minima y maxima de las casillas del trozo t
+	*/
+	void calculaAlturasTrozo(Trozo &t) const{
+		t.alturaMin = get(t.i0, t.j0);
+		t.alturaMax = t.alturaMin;
+		for (int i = t.i0; i <= finTrozo(t.i0); ++i){
+			for (int j = t.j0; j <= finTrozo(t.j0); ++j){
+				float h = get(i, j);
+				t.alturaMin = (std::min)(t.alturaMin, h);
+				t.alturaMax = (std::max)(t.alturaMax, h);
+			}
+		}
+	}
 
+	/**
+	* Calcula, sin generar sus vertices, el rectangulo que ocupa en pantalla el trozo t: perspective() es una
+	* proyeccion, asi que basta con proyectar las esquinas de la caja que forman las casillas del trozo entre la
+	* altura 0 y su altura maxima (o la del agua si es mayor). Se deja un margen por el redondeo de gira()
+	*/
+	void calculaLimites(const Giro &g, Trozo &t) const{
+		int fI = finTrozo(t.i0);
+		int fJ = finTrozo(t.j0);
+		int alto = (std::max)((int)t.alturaMax, alturaAgua);
+		int esquinas[4][2] = { { t.i0, t.j0 }, { fI, t.j0 }, { t.i0, fJ }, { fI, fJ } };
+		for (int e = 0; e < 4; ++e){
+			sf::Vector2i p = gira(g, esquinas[e][0], esquinas[e][1]);
+			if (e == 0){
+				t.limites = sf::FloatRect(perspective(p.x, p.y, 0), sf::Vector2f(0, 0));
+			}
+			amplia(t.limites, perspective(p.x, p.y, 0));
+			amplia(t.limites, perspective(p.x + 1, p.y, 0));
+			amplia(t.limites, perspective(p.x, p.y, alto));
+			amplia(t.limites, perspective(p.x + 1, p.y, alto));
+		}
+		const float margen = 2;
+		t.limites.left -= margen;
+		t.limites.top -= margen;
+		t.limites.width += 2 * margen;
+		t.limites.height += 2 * margen;
 
-				y = initYOff + offY;
-				y += -std::sin(r) * (i - m) + std::cos(r)*(j - n) + n;
+		/*
+		* perspective() divide entre py = (size - iso.y)*0.005 + 1, y una casilla mas en x avanza 0.5 en iso.x, que se
+		* multiplica por 6. Asi que en el centro del trozo dos casillas vecinas quedan a 3 / py en pantalla
+		*/
+		sf::Vector2i c = gira(g, (t.i0 + fI) / 2, (t.j0 + fJ) / 2);
+		float py = (size - iso(c.x, c.y).y)*0.005 + 1;
+		t.pasoCelda = 3 / py;
+	}
 
-				auto val = get(i, j);
-				auto top = perspective(x, y, val);
-				auto bottom = perspective(x + 1, y, 0);
+	/**
+	* Crea los trozos y la piramide de maximos de los niveles de detalle. Hay tantos niveles como veces se puede
+	* dividir el mapa por 2 dejando al menos 8 muestras por lado, sin que un grupo sea mayor que un trozo
+	*/
+	void calculaTrozos(){
+		numNiveles = 1;
+		while ((1 << numNiveles) <= LADO_TROZO && (this->max >> numNiveles) >= 8) ++numNiveles;
+		maximos.assign(numNiveles - 1, std::vector<float>());
+		for (int k = 1; k < numNiveles; ++k){
+			maximos[k - 1].resize(tamNivel(k) * tamNivel(k));
+		}
+		calculaMaximos(0, 0, this->max, this->max);
+
+		trozosPorLado = (size + LADO_TROZO - 1) / LADO_TROZO;
+		trozos.assign(trozosPorLado * trozosPorLado, Trozo());
+		for (int ti = 0; ti < trozosPorLado; ++ti){
+			for (int tj = 0; tj < trozosPorLado; ++tj){
+				Trozo &t = trozos[ti * trozosPorLado + tj];
+				t.i0 = ti * LADO_TROZO;
+				t.j0 = tj * LADO_TROZO;
+				t.nivel = 0;
+				t.sucio = true;
+				t.va.setPrimitiveType(sf::PrimitiveType::Lines);
+				calculaAlturasTrozo(t);
+			}
+		}
+	}
 
-				if (h < alturaAgua){
-					top = perspective(x, y, alturaAgua);
-				}
+	/**
+	* Actualiza los datos de dibujo tras cambiar las alturas de las casillas [x0,x1] x [y0,y1]: la piramide de maximos
+	* y los trozos que tocan el rectangulo, que quedan sucios. Las normales (y la luz) de las casillas vecinas usan
+	* esas alturas, asi que tambien se ensucian los trozos que tocan el rectangulo ampliado una casilla por cada lado
+	*/
+	void actualizaRegion(int x0, int y0, int x1, int y1){
+		calculaMaximos(x0, y0, x1, y1);
+		if (iluminacion.actualizaRegion(this->map, x0, y0, x1, y1) && sombreado){
+			// Con sombras u oclusion la luz puede haber cambiado en cualquier parte
+			for (auto &t : trozos){
+				t.sucio = true;
+			}
+		}
+		int bx0 = (std::max)(x0 - 1, 0), by0 = (std::max)(y0 - 1, 0);
+		int bx1 = (std::min)(x1 + 1, this->max), by1 = (std::min)(y1 + 1, this->max);
+		Giro g = giro();
+		for (int ti = bx0 / LADO_TROZO; ti <= bx1 / LADO_TROZO; ++ti){
+			for (int tj = by0 / LADO_TROZO; tj <= by1 / LADO_TROZO; ++tj){
+				Trozo &t = trozos[ti * trozosPorLado + tj];
+				calculaAlturasTrozo(t);
+				calculaLimites(g, t);
+				t.sucio = true;
+			}
+		}
+	}
+
+	/**
+	* Elige el nivel de detalle del trozo t para una vista con unidadesPorPixel unidades del mundo por pixel:
+	* el nivel k tal que una muestra (2^k casillas) ocupe al menos un pixel. Solo cambia de nivel si el zoom se sale
+	* del nivel actual del trozo mas de un margen (histeresis), para que no parpadee al estar justo en el limite
+	* entre dos niveles
+	*/
+	int eligeNivel(const Trozo &t, float unidadesPorPixel) const{
+		const float histeresis = 0.25f;
+		float pixelsPorCelda = t.pasoCelda / unidadesPorPixel;
+		float lod = -std::log(pixelsPorCelda) / std::log(2.0f);
+		if (lod >= t.nivel - histeresis && lod <= t.nivel + 1 + histeresis){
+			return t.nivel;
+		}
+		int nivel = (int)std::floor(lod);
+		return (std::max)(0, (std::min)(nivel, numNiveles - 1));
+	}
+
+	/**
+	* Tras un giro, todos los trozos cambian: se marcan como sucios y se recalcula donde caen en pantalla.
+	* Sus vertices no se generan aqui, sino en draw() y solo para los trozos visibles
+	*/
+	void calculateVertex(){
+		Giro g = giro();
+		for (auto &t : trozos){
+			calculaLimites(g, t);
+			t.sucio = true;
+		}
+	}
+
+	/**
+	* Calcula la linea vertical (de top a bottom) de la muestra (I,J) del nivel de detalle k
+	*/
+	int lineaMuestra(const Giro &g, int k, int I, int J, sf::Vertex &top, sf::Vertex &bottom) const{
+		int paso = 1 << k;
+		// Cada muestra se coloca en la casilla central de su grupo
+		int i = (std::min)(I * paso + paso / 2, this->max);
+		int j = (std::min)(J * paso + paso / 2, this->max);
+		auto val = alturaNivel(k, I, J);
+		int h = val;
+		sf::Color c = colorAltura(h);
+		if (sombreado){
+			c = Iluminacion::modula(c, iluminacion.getLuz(i, j));
+		}
+
+		sf::Vector2i p = gira(g, i, j);
+		top = sf::Vertex(perspective(p.x, p.y, val), c);
+		bottom = sf::Vertex(perspective(p.x + 1, p.y, 0), c);
+
+		if (h < alturaAgua){
+			top.position = perspective(p.x, p.y, alturaAgua);
+			return alturaAgua;
+		}
+		return h;
+	}
+
+	/**
+	* Anade un tramo al final de la lista, o lo junta con el ultimo si es del mismo tipo y le sigue
+	*/
+	static void anadeTramo(std::vector<Tramo> &tramos, bool quads, size_t inicio, size_t cuenta){
+		if (cuenta == 0) return;
+		if (!tramos.empty() && tramos.back().quads == quads && tramos.back().inicio + tramos.back().cuenta == inicio){
+			tramos.back().cuenta += cuenta;
+			return;
+		}
+		Tramo tr = { quads, inicio, cuenta };
+		tramos.push_back(tr);
+	}
+
+	/**
+	* Da la vuelta a un array de vertices
+	*/
+	static void invierte(sf::VertexArray &va){
+		int n = va.getVertexCount();
+		sf::Vertex vaux;
+		for (int i = 0; i < n / 2; ++i){
+			vaux = va[i];
+			va[i] = va[n - 1 - i];
+			va[n - 1 - i] = vaux;
+		}
+	}
 
-				sf::Vertex v3(top, c);
-				va.append(v3);
-				sf::Vertex v4(bottom, c);
-				va.append(v4);
+	/**
+	* Rellena los vertices del trozo t con el nivel de detalle k, con una linea vertical por muestra.
+	*
+	* Las muestras seguidas de una fila que se dibujan a la misma altura y con el mismo color (el mar, que se dibuja
+	* a la altura del agua, o zonas llanas) se juntan en un solo quad que va del tope de la primera al de la ultima y
+	* baja hasta sus bases, en lugar de una linea por muestra.
+	* Las filas se solapan en pantalla y dentro de una fila las muestras van de la mas lejana a la mas cercana, asi que
+	* quads y lineas se dibujan en el mismo orden en que salen: tramos guarda esa secuencia, con un tramo nuevo cada vez
+	* que se pasa de quads a lineas o al reves
+	*/
+	void calculateVertex(Trozo &t, int k) const{
+		sf::VertexArray &va = t.va;
+		va.clear();
+		t.quads.clear();
+		t.quads.setPrimitiveType(sf::PrimitiveType::Quads);
+		t.tramos.clear();
+		Giro g = giro();
+		int finJ = finTrozo(t.j0) >> k;
+		std::vector<sf::Vertex> tops(finJ + 1), bottoms(finJ + 1);
+		std::vector<int> alturas(finJ + 1);
+		for (int I = t.i0 >> k; I <= (finTrozo(t.i0) >> k); ++I){
+			for (int J = t.j0 >> k; J <= finJ; ++J){
+				alturas[J] = lineaMuestra(g, k, I, J, tops[J], bottoms[J]);
+			}
+			int J = t.j0 >> k;
+			while (J <= finJ){
+				int fin = J;
+				while (fin + 1 <= finJ && alturas[fin + 1] == alturas[J] && tops[fin + 1].color == tops[J].color){
+					++fin;
+				}
+				if (fin - J + 1 >= TIRA_MINIMA){
+					anadeTramo(t.tramos, true, t.quads.getVertexCount(), 4);
+					t.quads.append(tops[J]);
+					t.quads.append(tops[fin]);
+					t.quads.append(bottoms[fin]);
+					t.quads.append(bottoms[J]);
+				}
+				else{
+					anadeTramo(t.tramos, false, va.getVertexCount(), 2 * (fin - J + 1));
+					for (int s = J; s <= fin; ++s){
+						va.append(tops[s]);
+						va.append(bottoms[s]);
+					}
+				}
+				J = fin + 1;
 			}
 		}
 		if (angle >180){
-			int n = va.getVertexCount();
-			sf::Vertex vaux;
-			for (int i = 0; i < n / 2; ++i){
-				vaux = va[i];
-				va[i] = va[n - 1 - i];
-				va[n - 1 - i] = vaux;
+			/*
+			* Al dar la vuelta a los arrays, cada rango [inicio, inicio+cuenta) pasa a ser
+			* [n-inicio-cuenta, n-inicio) y el orden de los tramos se invierte
+			*/
+			invierte(va);
+			invierte(t.quads);
+			std::reverse(t.tramos.begin(), t.tramos.end());
+			for (auto &tr : t.tramos){
+				size_t n = tr.quads ? t.quads.getVertexCount() : va.getVertexCount();
+				tr.inicio = n - tr.inicio - tr.cuenta;
 			}
 		}
-
+		t.nivel = k;
+		t.sucio = false;
 	}
 
+	/**
+	* Rellena los vertices de TODOS los trozos con el nivel de detalle k en modo horizonte.
+	*
+	* La profundidad de una muestra es x+y una vez girada (cuanto mayor, mas cerca y mas abajo en pantalla), y depende
+	* linealmente de (I,J): cu*I + cv*J. Las muestras se recorren por franjas de profundidad de la mas cercana a la mas
+	* lejana; dentro de cada franja, para cada valor del eje con menor coeficiente hay como mucho dos muestras del
+	* otro eje, que se obtienen despejando. Asi el recorrido es lineal y no hace falta ordenar las muestras.
+	*
+	* La base de una linea lejana siempre queda por encima de la de una cercana, de modo que en cada columna de
+	* pantalla lo ya pintado va desde el horizonte hacia abajo: una linea cuyo tope esta por debajo del horizonte no
+	* se ve, y si no, se recorta en el horizonte
+	*/
+	void calculateVertexHorizonte(int k) const{
+		Giro g = giro();
+		float xMin = trozos[0].limites.left;
+		float xMax = xMin;
+		for (auto &t : trozos){
+			t.va.clear();
+			t.quads.clear();
+			t.tramos.clear();
+			xMin = (std::min)(xMin, t.limites.left);
+			xMax = (std::max)(xMax, t.limites.left + t.limites.width);
+		}
+		int columnas = (int)(xMax - xMin) + 1;
+		std::vector<float> horizonte(columnas, FLT_MAX);
+
+		int tam = tamNivel(k);
+		float a = g.coseno - g.seno;
+		float b = g.seno + g.coseno;
+		bool despejaJ = std::fabs(b) >= std::fabs(a);	// se despeja el eje de mayor coeficiente
+		float cu = despejaJ ? a : b;
+		float cv = despejaJ ? b : a;
+		float esquinas[4] = { 0, cu * (tam - 1), cv * (tam - 1), (cu + cv) * (tam - 1) };
+		int dMin = (int)std::floor(*std::min_element(esquinas, esquinas + 4));
+		int dMax = (int)std::floor(*std::max_element(esquinas, esquinas + 4));
+
+		sf::Vertex top, bottom;
+		for (int d = dMax; d >= dMin; --d){
+			for (int u = 0; u < tam; ++u){
+				float v0 = (d - cu * u) / cv;
+				float v1 = (d + 1 - cu * u) / cv;
+				int vIni = (std::max)(0, (int)std::ceil((std::min)(v0, v1)) - 1);
+				int vFin = (std::min)(tam - 1, (int)std::floor((std::max)(v0, v1)) + 1);
+				for (int v = vIni; v <= vFin; ++v){
+					if ((int)std::floor(cu * u + cv * v) != d) continue;	// pertenece a otra franja
+					int I = despejaJ ? u : v;
+					int J = despejaJ ? v : u;
+					lineaMuestra(g, k, I, J, top, bottom);
+
+					int col = (std::max)(0, (std::min)((int)(top.position.x - xMin), columnas - 1));
+					float &hor = horizonte[col];
+					if (top.position.y >= hor) continue;	// tapada entera
+					if (bottom.position.y > hor){
+						float f = (hor - top.position.y) / (bottom.position.y - top.position.y);
+						bottom.position = top.position + (bottom.position - top.position) * f;
+					}
+					hor = top.position.y;
+
+					int paso = 1 << k;
+					Trozo &t = trozos[(I * paso / LADO_TROZO) * trozosPorLado + (J * paso / LADO_TROZO)];
+					t.va.append(top);
+					t.va.append(bottom);
+				}
+			}
+		}
+		for (auto &t : trozos){
+			t.nivel = k;
+			t.sucio = false;
+		}
+	}
 public:
 
 	/*
@@ -450,17 +894,97 @@ public:
 	*/
 	float *map;
 
+private:
+
+	/*
+	* Si el mapa se ha cargado proyectando un archivo en memoria (ver ArchivoMapa), map apunta dentro de vista y hay
+	* que cerrar la proyeccion en vez de liberar map. Si no, vista es nullptr
+	*/
+	void *vista;
+	HANDLE archivo, proyeccion;
+
+	/**
+	* Si las alturas estan en un archivo proyectado, las copia a memoria propia y cierra la proyeccion y el archivo
+	* (para poder reemplazarlo). map cambia de direccion, asi que lo que guarde el puntero tiene que volver a pedirlo
+	*/
+	void sueltaArchivo(){
+		if (vista == nullptr) return;
+		float *alturas = new float[size * size];
+		memcpy(alturas, map, sizeof(float) * size * size);
+		UnmapViewOfFile(vista);
+		CloseHandle(proyeccion);
+		CloseHandle(archivo);
+		vista = nullptr;
+		archivo = proyeccion = INVALID_HANDLE_VALUE;
+		map = alturas;
+		iluminacion.cambiaMapa(map);
+	}
+
+	/*
+	* Donde se buscan y guardan los mapas generados (no es del mapa). nullptr si no se usa
+	*/
+	AlmacenMapas *almacen;
+
+	// CONSTRUCTORA QUE ADOPTA UNAS ALTURAS YA HECHAS (las usa ArchivoMapa)
+	Map(int detail, int seed, float roughness, float *alturas) :
+		angle(0),
+		modoHorizonte(false),
+		sombreado(false),
+		size(pow(2, detail) + 1)
+	{
+		this->max = size - 1;
+		this->maxHeight = INT_MIN;
+		this->minHeight = INT_MAX;
+		this->map = alturas;
+		this->vista = nullptr;
+		this->archivo = this->proyeccion = INVALID_HANDLE_VALUE;
+		this->almacen = nullptr;
+		this->seed = seed;
+		this->roughness = roughness;
+	}
+
+	/**
+	* Prepara todo lo necesario para dibujar el mapa una vez que estan las alturas: colores, trozos y vertices
+	*/
+	void inicializaDibujo(){
+		grads = {
+			// Bottom color				// Top Color
+			sf::Color(165, 88, 11), sf::Color(196, 109, 23),
+			sf::Color(214, 183, 62), sf::Color(165, 88, 11),
+			sf::Color(183, 182, 179), sf::Color(196, 195, 192),
+			sf::Color(53, 130, 23), sf::Color(67, 150, 34),
+			sf::Color(139, 165, 153), sf::Color(160, 186, 173),
+			sf::Color(224, 224, 224), sf::Color(250, 250, 250),
+		};
+		steps = { 0, 20, 40, 80, 120, 200, 255 };
+
+		altoMapa = 255;
+		alturaAgua = (2 * altoMapa / 5);
+
+		calculaTrozos();
+		if (iluminacion.calculada()){
+			iluminacion.calculaNormales(this->map, size);
+		}
+		calculateVertex();
+	}
+
+public:
+
 	// CONTRUCTORA SIN SEMILLA
 	Map(int detail) :
 		angle(0),
-		size(pow(2, detail) + 1),
-		va(sf::PrimitiveType::Lines, size*size * 2)
+		modoHorizonte(false),
+		sombreado(false),
+		size(pow(2, detail) + 1)
 	{
 		//this->size = pow(2,detail) +1;
 		this->max = size - 1;
 		this->maxHeight = INT_MIN;
 		this->minHeight = INT_MAX;
 		this->map = new float[size * size];
+		this->vista = nullptr;
+		this->archivo = this->proyeccion = INVALID_HANDLE_VALUE;
+		this->almacen = nullptr;
 		//this->altoMapa = 200;
 		//this->alturaAgua = 3 * altoMapa / 5; // a partir de 3/5 de la altura hay agua
 		this->seed = time(NULL);
@@ -471,14 +995,18 @@ public:
 	// CONSTRUCTORA CON SEMILLA
 	Map(int detail, int seed) :
 		angle(0),
-		size(pow(2, detail) + 1),
-		va(sf::PrimitiveType::Lines, size*size * 2)
+		modoHorizonte(false),
+		sombreado(false),
+		size(pow(2, detail) + 1)
 	{
 		//this->size = pow(2, detail) + 1;
 		this->max = size - 1;
 		this->maxHeight = INT_MIN;
 		this->minHeight = INT_MAX;
 		this->map = new float[size * size];
+		this->vista = nullptr;
+		this->archivo = this->proyeccion = INVALID_HANDLE_VALUE;
+		this->almacen = nullptr;
 		//this->altoMapa = 200;
 		//this->alturaAgua = 3 * altoMapa / 5; // a partir de 3/5 de la altura hay agua
 		this->seed = seed;
@@ -486,6 +1014,47 @@ public:
 		//this->hdc = GetDC(GetConsoleWindow());
 	}
 
+	~Map(){
+		if (vista != nullptr){
+			UnmapViewOfFile(vista);
+			CloseHandle(proyeccion);
+			CloseHandle(archivo);
+		}
+		else{
+			delete[] map;
+		}
+	}
+
+	// El mapa es dueno de sus alturas (o de la proyeccion del archivo), no se puede copiar
+	Map(const Map&) = delete;
+	Map &operator=(const Map&) = delete;
+
+	/*
+	* Version del algoritmo de generacion. Hay que subirla cada vez que cambie lo que sale de divide/normalize para
+	* una misma semilla, asi los mapas guardados en un AlmacenMapas con la version anterior dejan de valer
+	*/
+	static const int VERSION_GENERADOR = 1;
+
+	/**
+	* Pone el almacen en el que generate busca los mapas antes de generarlos (nullptr para no usar ninguno)
+	*/
+	void setAlmacen(AlmacenMapas *almacen){
+		this->almacen = almacen;
+	}
+
+	/**
+	* Devuelve el nivel de detalle: size es 2^detalle + 1
+	*/
+	int getDetalle() const{
+		int detalle = 0;
+		while ((1 << detalle) + 1 < size) ++detalle;
+		return detalle;
+	}
+
+	float getRoughness() const{
+		return roughness;
+	}
+
 	// METODOS PUBLICOS
 
 	/**
@@ -494,32 +1063,48 @@ public:
 	void generate(float roughness) {
 		this->roughness = roughness;
 		// Roughness, valor entre 0 y 1 (aunque puede ser > 1)
-		this->set(0, 0, this->max * 3 / 4);
-		this->set(this->max, 0, this->max * 3 / 4);
-		this->set(this->max, this->max, this->max * 3 / 4);
-		this->set(0, this->max, this->max * 3 / 4);
+
 		/*
-		* Se pone un valor igual para todas las esquinas (size/3). Esto se puede variar, si se quiere, por ejemplo
-		* un mapa que caiga o que tenga una elevacion hacia una o varia esquinas.
+		* El almacen descomprime en un buffer aparte: si falla a medias (o el archivo resulta ser de otro mapa) no deja
+		* alturas ajenas en map
 		*/
-
-		grads = {
-			// Bottom color				// Top Color
-			sf::Color(165, 88, 11), sf::Color(196, 109, 23),
-			sf::Color(214, 183, 62), sf::Color(165, 88, 11),
-			sf::Color(183, 182, 179), sf::Color(196, 195, 192),
-			sf::Color(53, 130, 23), sf::Color(67, 150, 34),
-			sf::Color(139, 165, 153), sf::Color(160, 186, 173),
-			sf::Color(224, 224, 224), sf::Color(250, 250, 250),
-		};
-		steps = { 0, 20, 40, 80, 120, 200, 255 };
-
-		altoMapa = 255;
-		alturaAgua = (2 * altoMapa / 5);
-
-		divide(this->max);
-		normalize();
-		calculateVertex();
+		bool guardado = false;
+		if (almacen != nullptr){
+			std::vector<float> alturas(size * size);
+			guardado = almacen->busca(getDetalle(), seed, roughness, &alturas[0], size);
+			if (guardado){
+				memcpy(this->map, &alturas[0], sizeof(float) * size * size);
+			}
+		}
+		if (guardado){
+			this->minHeight = INT_MAX;
+			this->maxHeight = INT_MIN;
+			for (int i = 0; i < size * size; ++i){
+				this->minHeight = (std::min)(this->minHeight, (int)map[i]);
+				this->maxHeight = (std::max)(this->maxHeight, (int)map[i]);
+			}
+		}
+		else{
+			this->set(0, 0, this->max * 3 / 4);
+			this->set(this->max, 0, this->max * 3 / 4);
+			this->set(this->max, this->max, this->max * 3 / 4);
+			this->set(0, this->max, this->max * 3 / 4);
+			/*
+			* Se pone un valor igual para todas las esquinas (size/3). Esto se puede variar, si se quiere, por ejemplo
+			* un mapa que caiga o que tenga una elevacion hacia una o varia esquinas.
+			*/
+			divide(this->max);
+			normalize();
+		}
+		/*
+		* divide gasta un rand() por casilla y un mapa del almacen ninguno: se vuelve a sembrar para que lo que venga
+		* despues (R, modificaSector) salga igual venga el mapa de donde venga
+		*/
+		srand(this->seed);
+		inicializaDibujo();
+		if (almacen != nullptr && !guardado){
+			almacen->guarda(*this);
+		}
 
 	};
 
@@ -538,7 +1123,7 @@ public:
 	/**
 	* Devuelve la semilla del mapa actual
 	*/
-	int getSeed(){
+	int getSeed() const{
 		return this->seed;
 	}
 
@@ -561,6 +1146,40 @@ public:
 		return this->size;
 	}
 
+	/**
+	* Devuelve el color con el que se dibuja una altura (los colores del agua si esta por debajo de alturaAgua)
+	*/
+	sf::Color colorAltura(int h) const{
+		if (h < alturaAgua){
+			return calculaColorAgua(h);
+		}
+		return calculaColor(h);
+	}
+
+	/**
+	* Devuelve el color con el que se dibuja la casilla (x,y), con el sombreado si esta activo
+	*/
+	sf::Color colorCasilla(int x, int y) const{
+		sf::Color c = colorAltura(get(x, y));
+		if (sombreado){
+			c = Iluminacion::modula(c, iluminacion.getLuz(x, y));
+		}
+		return c;
+	}
+
+	/**
+	* Proyecta n puntos (x, y, altura) del mapa a pantalla con el giro y la perspectiva con los que se dibuja el mapa,
+	* dejando el resultado en la posicion de salida[0..n). Lo que esta por debajo del agua se sube a alturaAgua
+	*/
+	void proyecta(const sf::Vector3f *puntos, size_t n, sf::Vertex *salida) const{
+		Giro g = giro();
+		for (size_t k = 0; k < n; ++k){
+			sf::Vector2i p = gira(g, puntos[k].x, puntos[k].y);
+			int z = puntos[k].z;
+			salida[k].position = perspective(p.x, p.y, (std::max)(z, alturaAgua));
+		}
+	}
+
 	/**
 	* Referido a las distintas persepectivas desde las que se puede ver el mapa
 	* De izquierda a derecha, frontalmente, o de derecha a izquierda
@@ -583,6 +1202,107 @@ public:
 		peekHeight = t;
 	}
 
+	/**
+	* Activa o desactiva el modo horizonte (ver calculateVertexHorizonte)
+	*/
+	void setModoHorizonte(bool activo){
+		modoHorizonte = activo;
+		for (auto &t : trozos){
+			t.sucio = true;
+		}
+	}
+
+	bool getModoHorizonte() const{
+		return modoHorizonte;
+	}
+
+	/**
+	* Activa o desactiva el sombreado del relieve. Las normales se calculan la primera vez que se activa
+	*/
+	void setSombreado(bool activo){
+		if (activo && !iluminacion.calculada()){
+			iluminacion.calculaNormales(this->map, size);
+		}
+		sombreado = activo;
+		for (auto &t : trozos){
+			t.sucio = true;
+		}
+	}
+
+	bool getSombreado() const{
+		return sombreado;
+	}
+
+	/**
+	* Cambia la direccion del sol (en grados, ver Iluminacion::setSol). Solo se recalcula la luz, no las normales
+	*/
+	void setSol(float azimut, float elevacion){
+		iluminacion.setSol(azimut, elevacion);
+		if (sombreado){
+			for (auto &t : trozos){
+				t.sucio = true;
+			}
+		}
+	}
+
+	/**
+	* Activa o desactiva las sombras que arroja el relieve con el sol actual (solo se ven con el sombreado activo)
+	*/
+	void setSombras(bool activas){
+		if (!iluminacion.calculada()){
+			iluminacion.calculaNormales(this->map, size);
+		}
+		iluminacion.setSombras(activas);
+		if (sombreado){
+			for (auto &t : trozos){
+				t.sucio = true;
+			}
+		}
+	}
+
+	bool getSombras() const{
+		return iluminacion.getSombras();
+	}
+
+	/**
+	* Activa o desactiva la oclusion ambiental (solo se ve con el sombreado activo)
+	*/
+	void setOclusion(bool activa){
+		if (!iluminacion.calculada()){
+			iluminacion.calculaNormales(this->map, size);
+		}
+		iluminacion.setOclusion(activa);
+		if (sombreado){
+			for (auto &t : trozos){
+				t.sucio = true;
+			}
+		}
+	}
+
+	bool getOclusion() const{
+		return iluminacion.getOclusion();
+	}
+
+	int getAlturaAgua() const{
+		return alturaAgua;
+	}
+
+	/**
+	* Cambia la altura del agua. Solo se recalculan los trozos que tienen alguna casilla por debajo del nivel
+	* antiguo o del nuevo, que son las unicas que cambian de color o de altura dibujada
+	*/
+	void setAlturaAgua(int altura){
+		int limite = (std::max)(altura, alturaAgua);
+		alturaAgua = altura;
+		Giro g = giro();
+		for (auto &t : trozos){
+			calculaLimites(g, t);
+			if (t.alturaMin < limite){
+				t.sucio = true;
+			}
+		}
+	}
+
 	virtual void rotate(float angle){
 		this->angle += angle;
 		while (this->angle > 360){
@@ -615,7 +1335,54 @@ public:
 		ct.setOutlineThickness(1);
 		ct.setOutlineColor(sf::Color::Green);
 		ct.setPosition(50 + size / 2, 50 + size / 2);
-		target.draw(va);
+
+		/*
+		* Rectangulo del mundo que se ve con la vista activa: la inversa de la vista lleva las esquinas de la
+		* pantalla (-1,-1)..(1,1) a coordenadas del mapa. Se dibujan solo los trozos que lo cortan, recalculando
+		* antes los que esten sucios o necesiten otro nivel de detalle.
+		* Con angle > 180 el orden de dibujo se invierte (igual que los vertices de cada trozo)
+		*/
+		const sf::View &vista = target.getView();
+		float unidadesPorPixel = vista.getSize().x / (vista.getViewport().width * target.getSize().x);
+		sf::FloatRect visible = vista.getInverseTransform().transformRect(sf::FloatRect(-1, -1, 2, 2));
+		int n = trozos.size();
+		if (modoHorizonte && n > 0){
+			/*
+			* En modo horizonte todos los trozos se calculan a la vez y con el mismo nivel (el mas fino que pida
+			* algun trozo visible), porque lo que tapa a una linea puede estar en cualquier otro trozo
+			*/
+			int nivel = numNiveles - 1;
+			bool sucio = false;
+			for (auto &t : trozos){
+				if (t.limites.intersects(visible)){
+					nivel = (std::min)(nivel, eligeNivel(t, unidadesPorPixel));
+				}
+				sucio = sucio || t.sucio;
+			}
+			if (sucio || trozos[0].nivel != nivel){
+				calculateVertexHorizonte(nivel);
+			}
+		}
+		for (int idx = 0; idx < n; ++idx){
+			Trozo &t = trozos[(angle > 180) ? n - 1 - idx : idx];
+			if (!t.limites.intersects(visible)) continue;
+			if (modoHorizonte){
+				target.draw(t.va);
+				continue;
+			}
+			int nivel = eligeNivel(t, unidadesPorPixel);
+			if (t.sucio || nivel != t.nivel){
+				calculateVertex(t, nivel);
+			}
+			for (auto &tr : t.tramos){
+				if (tr.quads){
+					target.draw(&t.quads[tr.inicio], tr.cuenta, sf::PrimitiveType::Quads);
+				}
+				else{
+					target.draw(&t.va[tr.inicio], tr.cuenta, sf::PrimitiveType::Lines);
+				}
+			}
+		}
 		target.draw(ct);
 	}
 	/**
@@ -633,7 +1400,9 @@ public:
 			int destX = origX + tam;
 			int destY = origY + tam;
 			if (destX >= 0 && destX < size && destY >= 0 && destY < size){
-				Map* modified = new Map(lado);
+				// Con una semilla sacada de rand() (y no de la hora, como Map(lado)): el sector depende de la semilla
+				// del mapa y de las ediciones anteriores, como lo demas que usa rand()
+				Map* modified = new Map(lado, rand());
 				for (int i = origX, iM = 0; i < destX; ++i, ++iM){
 					for (int j = origY, jM = 0; j < destY; ++j, ++jM){
 						modified->set(iM, jM, this->get(i, j));
@@ -647,6 +1416,7 @@ public:
 					}
 				}
 				delete modified;
+				actualizaRegion(origX, origY, destX - 1, destY - 1);
 			}
 		}
 	}
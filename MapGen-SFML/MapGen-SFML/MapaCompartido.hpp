@@ -0,0 +1,388 @@
+#ifndef MAPACOMPARTIDO_HPP
+#define MAPACOMPARTIDO_HPP
+
+#include <SFML\Graphics.hpp>
+#include <Windows.h>
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <string.h>
+#include "Map.hpp"
+
+/*
+* Mapa compartido entre procesos: un generador publica su mapa (y despues cada edicion) en una seccion de memoria
+* con nombre, y los visores y herramientas de analisis la abren y leen las alturas de esas mismas paginas, sin
+* regenerar el mapa ni cargarlo del disco.
+*
+* La seccion tiene una cabecera y detras las alturas, fila a fila como en Map. La cabecera lleva un seqlock: el
+* generador pone la secuencia impar antes de escribir y par al terminar, y un lector da por buena una lectura solo
+* si la secuencia era par y no ha cambiado al acabar (si no, repite). Asi los lectores nunca bloquean al generador
+* ni ven un mapa a medio escribir. Cada publicacion guarda ademas el rectangulo que ha cambiado, para que un visor
+* copie solo eso.
+*
+* Solo puede haber un publicador por nombre. La seccion esta en la memoria del sistema (no en un archivo) y
+* desaparece cuando la cierran todos los procesos que la tienen abierta
+*/
+class MapaCompartido {
+public:
+
+	static const sf::Uint32 VERSION = 1;
+
+	/* Publicaciones de las que se recuerda el rectangulo cambiado */
+	static const int REGIONES = 16;
+
+	struct Region {
+		sf::Int32 x0, y0, x1, y1;
+	};
+
+	struct Cabecera {
+		char marca[4];
+		sf::Uint32 version;
+		volatile LONG secuencia;	// Impar mientras el publicador escribe
+		sf::Uint32 detalleMaximo;	// El que cabe en la seccion
+		sf::Uint32 publicacion;		// Cuantas veces se ha publicado
+		sf::Uint32 detalle;
+		sf::Int32 semilla;
+		float roughness;
+		sf::Int32 alturaMin;
+		sf::Int32 alturaMax;
+		Region regiones[REGIONES];	// regiones[p % REGIONES]: lo que cambio en la publicacion p
+	};
+
+protected:
+
+	HANDLE proyeccion;
+	Cabecera *cabecera;
+	float *alturas;
+
+	MapaCompartido() :
+		proyeccion(NULL),
+		cabecera(nullptr),
+		alturas(nullptr)
+	{
+	}
+
+	~MapaCompartido(){
+		cierra();
+	}
+
+	static std::string nombreSeccion(const std::string &nombre){
+		return "Local\\MapGen-" + nombre;
+	}
+
+	static sf::Uint64 tamano(int detalle){
+		sf::Uint64 size = (1 << detalle) + 1;
+		return sizeof(Cabecera) + size * size * sizeof(float);
+	}
+
+	/**
+	* Lee la secuencia del seqlock. Las barreras impiden que las lecturas de las alturas se adelanten o se retrasen
+	* respecto a ella
+	*/
+	LONG secuencia() const{
+		MemoryBarrier();
+		LONG s = cabecera->secuencia;
+		MemoryBarrier();
+		return s;
+	}
+
+	/**
+	* Proyecta la seccion ya creada o abierta. Devuelve false (y la cierra) si no se puede
+	*/
+	bool proyecta(const std::string &nombre, DWORD acceso){
+		cabecera = (Cabecera*)MapViewOfFile(proyeccion, acceso, 0, 0, 0);
+		if (cabecera == NULL){
+			std::cout << nombre << ": no se puede proyectar (" << GetLastError() << ")" << std::endl;
+			cierra();
+			return false;
+		}
+		alturas = (float*)(cabecera + 1);
+		return true;
+	}
+
+public:
+
+	MapaCompartido(const MapaCompartido&) = delete;
+	MapaCompartido &operator=(const MapaCompartido&) = delete;
+
+	bool abierto() const{
+		return cabecera != nullptr;
+	}
+
+	void cierra(){
+		if (cabecera != nullptr){
+			UnmapViewOfFile(cabecera);
+			cabecera = nullptr;
+			alturas = nullptr;
+		}
+		if (proyeccion != NULL){
+			CloseHandle(proyeccion);
+			proyeccion = NULL;
+		}
+	}
+};
+
+/*
+* Lado del generador: crea la seccion y publica en ella
+*/
+class PublicadorMapa : public MapaCompartido {
+private:
+
+	/**
+	* Escribe las casillas [x0,x1] x [y0,y1] del mapa dentro del seqlock y las apunta como cambiadas
+	*/
+	void escribe(const Map &m, int x0, int y0, int x1, int y1){
+		Cabecera &c = *cabecera;
+		int size = m.getSize();
+		InterlockedIncrement(&c.secuencia);
+		c.detalle = m.getDetalle();
+		c.semilla = m.seed;
+		c.roughness = m.roughness;
+		c.alturaMin = m.minHeight;
+		c.alturaMax = m.maxHeight;
+		for (int y = y0; y <= y1; ++y){
+			memcpy(alturas + x0 + size * y, m.map + x0 + size * y, (x1 - x0 + 1) * sizeof(float));
+		}
+		sf::Uint32 p = c.publicacion + 1;
+		Region &r = c.regiones[p % REGIONES];
+		r.x0 = x0; r.y0 = y0; r.x1 = x1; r.y1 = y1;
+		c.publicacion = p;
+		InterlockedIncrement(&c.secuencia);
+	}
+
+public:
+
+	/**
+	* Crea (o reutiliza, si ya existe y es suficientemente grande) la seccion nombre, con sitio para mapas de hasta
+	* detalleMaximo. Hay que comprobar abierto()
+	*/
+	PublicadorMapa(const std::string &nombre, int detalleMaximo){
+		sf::Uint64 tam = tamano(detalleMaximo);
+		proyeccion = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(tam >> 32),
+			(DWORD)tam, nombreSeccion(nombre).c_str());
+		if (proyeccion == NULL){
+			std::cout << nombre << ": no se puede crear la memoria compartida (" << GetLastError() << ")" << std::endl;
+			return;
+		}
+		bool existia = GetLastError() == ERROR_ALREADY_EXISTS;
+		if (!proyecta(nombre, FILE_MAP_ALL_ACCESS)) return;
+		Cabecera &c = *cabecera;
+		if (existia && memcmp(c.marca, "MGSH", 4) == 0){
+			if (c.version != VERSION || (int)c.detalleMaximo < detalleMaximo){
+				std::cout << nombre << ": ya existe una memoria compartida incompatible con ese nombre" << std::endl;
+				cierra();
+			}
+			else if (c.secuencia & 1){
+				// El publicador anterior termino a medias: se deja la secuencia par para que se pueda volver a leer
+				InterlockedIncrement(&c.secuencia);
+			}
+			return;
+		}
+		// Seccion nueva (a ceros): la marca va al final para que un lector no la use antes de tiempo
+		c.version = VERSION;
+		c.detalleMaximo = detalleMaximo;
+		MemoryBarrier();
+		memcpy(c.marca, "MGSH", 4);
+	}
+
+	/**
+	* Publica el mapa entero (un mapa nuevo). Devuelve false si no cabe en la seccion
+	*/
+	bool publica(const Map &m){
+		if (!abierto()) return false;
+		if (m.getDetalle() > (int)cabecera->detalleMaximo){
+			std::cout << "Mapa compartido: el mapa no cabe (detalle " << m.getDetalle() << ", maximo "
+				<< cabecera->detalleMaximo << ")" << std::endl;
+			return false;
+		}
+		escribe(m, 0, 0, m.getSize() - 1, m.getSize() - 1);
+		return true;
+	}
+
+	/**
+	* Publica una edicion del mapa ya publicado: solo las casillas [x0,x1] x [y0,y1]. Si el mapa publicado es de otro
+	* tamano se publica entero
+	*/
+	bool publicaRegion(const Map &m, int x0, int y0, int x1, int y1){
+		if (!abierto()) return false;
+		if ((int)cabecera->detalle != m.getDetalle() || cabecera->publicacion == 0){
+			return publica(m);
+		}
+		int size = m.getSize();
+		x0 = (std::max)(x0, 0);
+		y0 = (std::max)(y0, 0);
+		x1 = (std::min)(x1, size - 1);
+		y1 = (std::min)(y1, size - 1);
+		if (x0 <= x1 && y0 <= y1){
+			escribe(m, x0, y0, x1, y1);
+		}
+		return true;
+	}
+};
+
+/*
+* Lado de los visores y herramientas: abren la seccion y leen de ella
+*/
+class LectorMapa : public MapaCompartido {
+private:
+
+	sf::Uint32 ultima;	// Ultima publicacion copiada a un Map (con carga o actualiza)
+
+	// Tiempo maximo que lee() reintenta mientras el publicador escribe. Si se pasa (p.ej. el publicador ha muerto a
+	// medio escribir y la secuencia se ha quedado impar) lee() se rinde y se sigue con lo ultimo que se copio
+	static const int ESPERA_MAXIMA_MS = 500;
+
+	static void espera(){
+		SwitchToThread();
+	}
+
+public:
+
+	LectorMapa() :
+		ultima(0)
+	{
+	}
+
+	/**
+	* Abre la seccion de un publicador. Devuelve false si no existe (todavia) o no es valida
+	*/
+	bool abre(const std::string &nombre){
+		cierra();
+		ultima = 0;
+		proyeccion = OpenFileMappingA(FILE_MAP_READ, FALSE, nombreSeccion(nombre).c_str());
+		if (proyeccion == NULL) return false;
+		if (!proyecta(nombre, FILE_MAP_READ)) return false;
+		if (memcmp(cabecera->marca, "MGSH", 4) != 0 || cabecera->version != VERSION){
+			std::cout << nombre << ": memoria compartida no valida" << std::endl;
+			cierra();
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	* Numero de la ultima publicacion (0 si todavia no hay mapa)
+	*/
+	sf::Uint32 getPublicacion() const{
+		return abierto() ? cabecera->publicacion : 0;
+	}
+
+	/**
+	* Alturas publicadas, directamente en la memoria compartida. Solo son coherentes dentro de lee()
+	*/
+	const float *getAlturas() const{
+		return alturas;
+	}
+
+	/**
+	* Lee el mapa publicado sin copiarlo: llama a f(cabecera, alturas) hasta que lo hace sin que el publicador
+	* escriba a la vez. f puede ver datos a medias en los intentos que se repiten (solo tiene que no fallar con
+	* ellos) y el resultado que vale es el del ultimo. Devuelve false si todavia no hay mapa (o no esta abierto) o si
+	* no consigue una lectura limpia en ESPERA_MAXIMA_MS; en ese caso lo que haya hecho f no vale
+	*/
+	template <class F>
+	bool lee(F f) const{
+		if (!abierto()) return false;
+		sf::Clock reloj;
+		for (;;){
+			LONG s = secuencia();
+			if (!(s & 1)){
+				if (cabecera->publicacion == 0) return false;
+				f((const Cabecera&)*cabecera, (const float*)alturas);
+				if (secuencia() == s) return true;
+			}
+			if (reloj.getElapsedTime().asMilliseconds() > ESPERA_MAXIMA_MS) return false;
+			espera();
+		}
+	}
+
+	/**
+	* Copia el mapa publicado en un Map nuevo, listo para dibujar (del llamante). nullptr si todavia no hay mapa
+	*/
+	Map *carga(){
+		Cabecera c;
+		float *copia = nullptr;
+		int capacidad = 0;
+		bool hay = lee([&](const Cabecera &cab, const float *a){
+			c = cab;
+			int size = (1 << (std::min)(c.detalle, c.detalleMaximo)) + 1;
+			if (size * size > capacidad){
+				delete[] copia;
+				capacidad = size * size;
+				copia = new float[capacidad];
+			}
+			memcpy(copia, a, (size_t)size * size * sizeof(float));
+		});
+		if (!hay){
+			delete[] copia;
+			return nullptr;
+		}
+		ultima = c.publicacion;
+		Map *m = new Map(c.detalle, c.semilla, c.roughness, copia);
+		m->minHeight = c.alturaMin;
+		m->maxHeight = c.alturaMax;
+		m->inicializaDibujo();
+		return m;
+	}
+
+	/**
+	* Pone al dia un Map sacado de carga() con lo que se ha publicado desde entonces: copia solo los rectangulos que
+	* han cambiado (o todo si se han perdido muchas publicaciones) y rehace el dibujo de esa zona.
+	* Devuelve true si m ha cambiado. Si se ha publicado un mapa de otro tamano devuelve false: hay que volver a
+	* llamar a carga(). Si el publicador no deja leer (ver lee) m se queda como estaba, salvo que ya se hubiera
+	* copiado algo a medias: entonces se redibuja esa zona y se vuelve a copiar en la siguiente llamada que lo consiga
+	*/
+	bool actualiza(Map &m){
+		int size = m.getSize();
+		Region r;
+		Region copiada;	// Lo que se ha copiado a m en todos los intentos (puede haber quedado a medias)
+		sf::Uint32 publicacion = 0;
+		bool otroTamano = false;
+		bool copiado = false;
+		bool limpia = lee([&](const Cabecera &c, const float *a){
+			publicacion = c.publicacion;
+			otroTamano = (int)c.detalle != m.getDetalle();
+			if (publicacion == ultima || otroTamano) return;
+			if (publicacion - ultima > (sf::Uint32)REGIONES || ultima == 0){
+				r.x0 = r.y0 = 0;
+				r.x1 = r.y1 = size - 1;
+			}
+			else{
+				r = c.regiones[publicacion % REGIONES];
+				for (sf::Uint32 p = ultima + 1; p != publicacion; ++p){
+					const Region &o = c.regiones[p % REGIONES];
+					r.x0 = (std::min)(r.x0, o.x0);
+					r.y0 = (std::min)(r.y0, o.y0);
+					r.x1 = (std::max)(r.x1, o.x1);
+					r.y1 = (std::max)(r.y1, o.y1);
+				}
+			}
+			if (r.x0 < 0 || r.y0 < 0 || r.x1 >= size || r.y1 >= size || r.x0 > r.x1 || r.y0 > r.y1){
+				// Solo puede pasar en un intento que se va a repetir
+				otroTamano = true;
+				return;
+			}
+			for (int y = r.y0; y <= r.y1; ++y){
+				memcpy(m.map + r.x0 + size * y, a + r.x0 + size * y, (r.x1 - r.x0 + 1) * sizeof(float));
+			}
+			if (!copiado) copiada = r;
+			copiada.x0 = (std::min)(copiada.x0, r.x0);
+			copiada.y0 = (std::min)(copiada.y0, r.y0);
+			copiada.x1 = (std::max)(copiada.x1, r.x1);
+			copiada.y1 = (std::max)(copiada.y1, r.y1);
+			copiado = true;
+		});
+		if (!limpia){
+			// ultima no avanza: la proxima lectura limpia vuelve a copiar esta zona
+			if (!copiado) return false;
+			m.actualizaRegion(copiada.x0, copiada.y0, copiada.x1, copiada.y1);
+			return true;
+		}
+		if (publicacion == ultima || otroTamano) return false;
+		ultima = publicacion;
+		m.actualizaRegion(r.x0, r.y0, r.x1, r.y1);
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef MUNDO_HPP
+#define MUNDO_HPP
+
+#include <SFML\Graphics.hpp>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+/*
+* Mundo mas grande de lo que cabe en un Map: una cuadricula de teselas, cada una de 2^detalle + 1 casillas de lado,
+* en la que las teselas vecinas comparten la fila o columna del borde.
+*
+* Cada tesela se puede generar sola, en cualquier orden y en cualquier proceso o maquina, y siempre sale igual:
+*
+*	- La altura de cada esquina sale de un hash de la semilla del mundo y su posicion.
+*	- Cada borde se genera con desplazamiento del punto medio (como Diamond-Square en una dimension) entre sus dos
+*	  esquinas, con una semilla que sale del borde. Las dos teselas que lo comparten lo calculan igual.
+*	- El interior se rellena con Diamond-Square (como Map::divide) sin tocar los bordes, con la semilla de la tesela.
+*
+* No se usa rand(): el generador aleatorio es propio para que el resultado no dependa del proceso ni del compilador.
+* Las alturas quedan entre 0 y 255, como en los mapas normales, pero sin normalizar (normalizar cada tesela por
+* separado romperia los bordes). Por eso el desplazamiento va en proporcion al lado de la tesela en vez de en casillas
+* (ver Parametros::roughness)
+*/
+class Mundo {
+public:
+
+	/*
+	* Version del algoritmo de generacion de teselas. Hay que subirla cada vez que cambie lo que sale de generaTesela
+	* para unos mismos parametros, asi un mundo a medias generado con la version anterior no se reanuda
+	*/
+	static const int VERSION_GENERADOR = 2;
+
+	struct Parametros {
+		int detalle;		// Cada tesela es de 2^detalle + 1
+		int teselasX;
+		int teselasY;
+		sf::Uint32 semilla;
+		/*
+		* Como en Map, el desplazamiento es proporcional al tramo: el de lado n se mueve como mucho
+		* roughness * RELIEVE * n / lado, y el primero (la tesela entera) roughness * RELIEVE. Map desplaza
+		* roughness * n casillas y despues normaliza a 0..255; aqui no se puede normalizar, asi que la escala es fija
+		*/
+		float roughness;
+	};
+
+private:
+
+	/**
+	* splitmix64: mezcla bien bits parecidos (semillas consecutivas dan secuencias sin relacion)
+	*/
+	static sf::Uint64 mezcla(sf::Uint64 x){
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+
+	static sf::Uint64 semilla(const Parametros &p, sf::Uint32 tipo, sf::Int32 x, sf::Int32 y){
+		return mezcla(mezcla(mezcla(p.semilla ^ ((sf::Uint64)tipo << 32)) ^ (sf::Uint32)x) ^ ((sf::Uint64)(sf::Uint32)y << 32));
+	}
+
+	/*
+	* Secuencia de numeros aleatorios a partir de una semilla
+	*/
+	class Aleatorio {
+	private:
+		sf::Uint64 estado;
+	public:
+		Aleatorio(sf::Uint64 semilla) :
+			estado(semilla)
+		{
+		}
+
+		/**
+		* Numero entre -1 y 1
+		*/
+		float siguiente(){
+			estado += 0x9E3779B97F4A7C15ULL;
+			sf::Uint64 x = mezcla(estado);
+			return (float)((double)(x >> 11) / (double)(1ULL << 53) * 2 - 1);
+		}
+	};
+
+	enum { ESQUINA = 1, BORDE_HORIZONTAL = 2, BORDE_VERTICAL = 3, INTERIOR = 4 };
+
+	/**
+	* Desplazamiento maximo del primer nivel con roughness 1: la mitad del rango de alturas
+	*/
+	static const int RELIEVE = 128;
+
+	/**
+	* Desplazamiento maximo de un tramo de lado tramo
+	*/
+	static float escala(const Parametros &p, int tramo){
+		return p.roughness * RELIEVE * tramo / (1 << p.detalle);
+	}
+
+	/**
+	* Altura de la esquina (x, y) de la cuadricula de teselas: entre 64 y 192
+	*/
+	static float esquina(const Parametros &p, int x, int y){
+		Aleatorio a(semilla(p, ESQUINA, x, y));
+		return 128 + 64 * a.siguiente();
+	}
+
+	/**
+	* Rellena las casillas de un borde de lado + 1 casillas (inicio, inicio + paso...) entre sus dos esquinas
+	*/
+	static void borde(const Parametros &p, sf::Uint64 s, float *inicio, int paso, float a, float b){
+		int lado = 1 << p.detalle;
+		Aleatorio aleatorio(s);
+		inicio[0] = a;
+		inicio[paso * lado] = b;
+		for (int tramo = lado; tramo > 1; tramo /= 2){
+			int mitad = tramo / 2;
+			float escala = Mundo::escala(p, tramo);
+			for (int i = mitad; i < lado; i += tramo){
+				inicio[paso * i] = (inicio[paso * (i - mitad)] + inicio[paso * (i + mitad)]) / 2 + aleatorio.siguiente() * escala;
+			}
+		}
+	}
+
+public:
+
+	/**
+	* Genera la tesela (tx, ty) en alturas, que tiene que tener sitio para (2^detalle + 1)^2 casillas, fila a fila
+	*/
+	static void generaTesela(const Parametros &p, int tx, int ty, float *alturas){
+		int lado = 1 << p.detalle, size = lado + 1;
+		float e00 = esquina(p, tx, ty), e10 = esquina(p, tx + 1, ty);
+		float e01 = esquina(p, tx, ty + 1), e11 = esquina(p, tx + 1, ty + 1);
+		borde(p, semilla(p, BORDE_HORIZONTAL, tx, ty), alturas, 1, e00, e10);
+		borde(p, semilla(p, BORDE_HORIZONTAL, tx, ty + 1), alturas + size * lado, 1, e01, e11);
+		borde(p, semilla(p, BORDE_VERTICAL, tx, ty), alturas, size, e00, e01);
+		borde(p, semilla(p, BORDE_VERTICAL, tx + 1, ty), alturas + lado, size, e10, e11);
+
+		Aleatorio a(semilla(p, INTERIOR, tx, ty));
+		for (int tramo = lado; tramo > 1; tramo /= 2){
+			int mitad = tramo / 2;
+			float escala = Mundo::escala(p, tramo);
+			// Centros de los cuadrados (square)
+			for (int y = mitad; y < lado; y += tramo){
+				for (int x = mitad; x < lado; x += tramo){
+					float *c = alturas + x + size * y;
+					c[0] = (c[-mitad - size * mitad] + c[mitad - size * mitad] + c[-mitad + size * mitad] +
+						c[mitad + size * mitad]) / 4 + a.siguiente() * escala;
+				}
+			}
+			// Puntos medios de los lados (diamond), menos los del borde, que ya estan
+			for (int y = mitad; y < lado; y += mitad){
+				for (int x = (y + mitad) % tramo; x <= lado; x += tramo){
+					if (x == 0 || x == lado) continue;
+					float *c = alturas + x + size * y;
+					c[0] = (c[-size * mitad] + c[mitad] + c[size * mitad] + c[-mitad]) / 4 + a.siguiente() * escala;
+				}
+			}
+		}
+		for (int i = 0; i < size * size; ++i){
+			alturas[i] = (std::max)(0.0f, (std::min)(255.0f, alturas[i]));
+		}
+	}
+
+	/**
+	* Nombre del archivo de la tesela (tx, ty) dentro del directorio del mundo
+	*/
+	static std::string archivoTesela(int tx, int ty){
+		std::ostringstream s;
+		s << tx << "_" << ty << ".mgs";
+		return s.str();
+	}
+};
+
+#endif
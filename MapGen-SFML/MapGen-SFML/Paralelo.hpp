@@ -0,0 +1,107 @@
+#ifndef PARALELO_HPP
+#define PARALELO_HPP
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/**
+* Ejecuta f(i) para cada i de [desde, hasta) repartiendo el trabajo entre tantos hilos como nucleos tenga la maquina.
+* Los hilos van cogiendo los indices de bloque en bloque de un contador compartido, asi el reparto sale equilibrado
+* aunque unos indices cuesten mas que otros.
+* f se ejecuta a la vez para indices distintos, asi que no puede escribir en datos compartidos entre indices
+*/
+template <class F>
+void paralelo(int desde, int hasta, F f, int bloque = 16){
+	int n = hasta - desde;
+	if (n <= 0) return;
+	int hilos = std::thread::hardware_concurrency();
+	if (hilos < 1) hilos = 1;
+	if (hilos == 1 || n <= bloque){
+		for (int i = desde; i < hasta; ++i){
+			f(i);
+		}
+		return;
+	}
+	std::atomic<int> siguiente(desde);
+	auto trabajo = [&](){
+		for (;;){
+			int inicio = siguiente.fetch_add(bloque);
+			if (inicio >= hasta) break;
+			int fin = (inicio + bloque < hasta) ? inicio + bloque : hasta;
+			for (int i = inicio; i < fin; ++i){
+				f(i);
+			}
+		}
+	};
+	std::vector<std::thread> ayudantes;
+	for (int h = 1; h < hilos; ++h){
+		ayudantes.push_back(std::thread(trabajo));
+	}
+	trabajo();
+	for (auto &t : ayudantes){
+		t.join();
+	}
+}
+
+/**
+* Cola con capacidad limitada para pasar trabajo de un hilo productor a uno consumidor. mete() espera mientras la
+* cola esta llena, asi el productor nunca se adelanta mas de capacidad elementos y la memoria queda acotada.
+* saca() espera mientras esta vacia y devuelve false cuando esta vacia y cerrada.
+* Cualquiera de los dos lados puede cerrarla
+*/
+template <class T>
+class ColaAcotada {
+private:
+
+	std::deque<T> elementos;
+	size_t capacidad;
+	bool cerrada;
+	std::mutex m;
+	std::condition_variable hayHueco, hayElementos;
+
+public:
+
+	ColaAcotada(size_t capacidad) :
+		capacidad(capacidad),
+		cerrada(false)
+	{
+	}
+
+	/**
+	* Devuelve false (y no mete nada) si la cola esta cerrada, por ejemplo porque el consumidor ha abandonado
+	*/
+	bool mete(T elemento){
+		std::unique_lock<std::mutex> l(m);
+		hayHueco.wait(l, [this](){ return elementos.size() < capacidad || cerrada; });
+		if (cerrada) return false;
+		elementos.push_back(std::move(elemento));
+		hayElementos.notify_one();
+		return true;
+	}
+
+	bool saca(T &elemento){
+		std::unique_lock<std::mutex> l(m);
+		hayElementos.wait(l, [this](){ return !elementos.empty() || cerrada; });
+		if (elementos.empty()) return false;
+		elemento = std::move(elementos.front());
+		elementos.pop_front();
+		hayHueco.notify_one();
+		return true;
+	}
+
+	/**
+	* No van a llegar mas elementos. Los que ya estan se pueden seguir sacando
+	*/
+	void cierra(){
+		std::lock_guard<std::mutex> l(m);
+		cerrada = true;
+		hayHueco.notify_all();
+		hayElementos.notify_all();
+	}
+};
+
+#endif
@@ -0,0 +1,378 @@
+#ifndef PNG_HPP
+#define PNG_HPP
+
+#include <SFML\Graphics.hpp>
+#include <ostream>
+#include <istream>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include "Compresion.hpp"
+
+/*
+* Escritura y lectura de PNG por filas, sin cargar la imagen entera (ver Exportador e Importador).
+* La escritura esta separada en dos partes que pueden ir en hilos distintos: FiltroPng prepara cada fila (el filtro
+* de prediccion de PNG) y EscritorPng la comprime y la escribe. LectorPng hace lo contrario
+*/
+
+/*
+* Aplica a cada fila el filtro de PNG que mejor la predice (None, Sub, Up, Average o Paeth, el que deja los valores
+* mas pequenos), recordando la fila anterior
+*/
+class FiltroPng {
+private:
+
+	int bytesFila;
+	int bytesPixel;
+	std::vector<sf::Uint8> anterior;
+	std::vector<sf::Uint8> prueba[5];
+
+	static sf::Uint8 paeth(int a, int b, int c){
+		int p = a + b - c;
+		int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+		if (pa <= pb && pa <= pc) return (sf::Uint8)a;
+		if (pb <= pc) return (sf::Uint8)b;
+		return (sf::Uint8)c;
+	}
+
+public:
+
+	/**
+	* bytesPixel es el numero de bytes de un pixel (redondeado a 1 como minimo), el que usan Sub, Average y Paeth
+	*/
+	FiltroPng(int bytesFila, int bytesPixel) :
+		bytesFila(bytesFila),
+		bytesPixel(bytesPixel),
+		anterior(bytesFila, 0)
+	{
+		for (int f = 0; f < 5; ++f){
+			prueba[f].resize(bytesFila + 1);
+			prueba[f][0] = (sf::Uint8)f;
+		}
+	}
+
+	/**
+	* Filtra la fila (bytesFila bytes) y deja en salida el byte del filtro elegido seguido de la fila filtrada
+	*/
+	void filtra(const sf::Uint8 *fila, std::vector<sf::Uint8> &salida){
+		const sf::Uint8 *arriba = &anterior[0];
+		int bpp = bytesPixel;
+		sf::Uint8 *n = &prueba[0][1], *s = &prueba[1][1], *u = &prueba[2][1], *a = &prueba[3][1], *p = &prueba[4][1];
+		for (int i = 0; i < bytesFila; ++i){
+			int izq = (i >= bpp) ? fila[i - bpp] : 0;
+			int diag = (i >= bpp) ? arriba[i - bpp] : 0;
+			n[i] = fila[i];
+			s[i] = (sf::Uint8)(fila[i] - izq);
+			u[i] = (sf::Uint8)(fila[i] - arriba[i]);
+			a[i] = (sf::Uint8)(fila[i] - ((izq + arriba[i]) >> 1));
+			p[i] = (sf::Uint8)(fila[i] - paeth(izq, arriba[i], diag));
+		}
+		int mejor = 0;
+		long mejorSuma = -1;
+		for (int f = 0; f < 5; ++f){
+			long suma = 0;
+			const sf::Uint8 *v = &prueba[f][1];
+			for (int i = 0; i < bytesFila; ++i){
+				suma += (v[i] < 128) ? v[i] : 256 - v[i];
+			}
+			if (mejorSuma < 0 || suma < mejorSuma){
+				mejorSuma = suma;
+				mejor = f;
+			}
+		}
+		salida.assign(prueba[mejor].begin(), prueba[mejor].end());
+		memcpy(&anterior[0], fila, bytesFila);
+	}
+};
+
+/*
+* Escribe un PNG en un ostream: la cabecera al crearlo, las filas ya filtradas con fila() y el final con termina().
+* Los datos comprimidos se van escribiendo en trozos IDAT de unos 64 KB segun salen
+*/
+class EscritorPng {
+public:
+
+	enum TipoColor { GRIS = 0, RGB = 2, INDEXADO = 3 };
+
+private:
+
+	std::ostream &salida;
+	Compresor compresor;
+
+	/*
+	* Tabla del CRC de los trozos. Cada escritor tiene la suya para poder escribir varios PNG a la vez sin
+	* sincronizar nada
+	*/
+	sf::Uint32 tablaCrc[256];
+
+	sf::Uint32 crc(const sf::Uint8 *p, size_t n, sf::Uint32 c) const{
+		for (size_t i = 0; i < n; ++i){
+			c = tablaCrc[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+		}
+		return c;
+	}
+
+	static void escribe32(sf::Uint8 *p, sf::Uint32 v){
+		p[0] = (sf::Uint8)(v >> 24);
+		p[1] = (sf::Uint8)(v >> 16);
+		p[2] = (sf::Uint8)(v >> 8);
+		p[3] = (sf::Uint8)v;
+	}
+
+	void escribeTrozo(const char *tipo, const sf::Uint8 *datos, size_t n){
+		sf::Uint8 cabecera[8];
+		escribe32(cabecera, (sf::Uint32)n);
+		memcpy(cabecera + 4, tipo, 4);
+		sf::Uint32 c = crc(cabecera + 4, 4, 0xFFFFFFFFu);
+		c = crc(datos, n, c) ^ 0xFFFFFFFFu;
+		sf::Uint8 fin[4];
+		escribe32(fin, c);
+		salida.write((const char*)cabecera, 8);
+		if (n > 0) salida.write((const char*)datos, n);
+		salida.write((const char*)fin, 4);
+	}
+
+	void vuelca(bool todo){
+		std::vector<sf::Uint8> &comprimido = compresor.getSalida();
+		if (comprimido.empty() || (!todo && comprimido.size() < (size_t)Compresor::BLOQUE)) return;
+		escribeTrozo("IDAT", &comprimido[0], comprimido.size());
+		comprimido.clear();
+	}
+
+public:
+
+	/**
+	* Escribe la firma y la cabecera de un PNG de ancho x alto, con profundidad bits por muestra. Para INDEXADO hay que
+	* dar la paleta (hasta 256 colores)
+	*/
+	EscritorPng(std::ostream &salida, int ancho, int alto, int profundidad, TipoColor tipo,
+		const std::vector<sf::Color> *paleta = nullptr) :
+		salida(salida)
+	{
+		for (sf::Uint32 i = 0; i < 256; ++i){
+			sf::Uint32 v = i;
+			for (int k = 0; k < 8; ++k){
+				v = (v & 1) ? 0xEDB88320u ^ (v >> 1) : v >> 1;
+			}
+			tablaCrc[i] = v;
+		}
+		static const sf::Uint8 firma[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		salida.write((const char*)firma, 8);
+		sf::Uint8 ihdr[13];
+		escribe32(ihdr, ancho);
+		escribe32(ihdr + 4, alto);
+		ihdr[8] = (sf::Uint8)profundidad;
+		ihdr[9] = (sf::Uint8)tipo;
+		ihdr[10] = 0;	// deflate
+		ihdr[11] = 0;	// filtros por fila
+		ihdr[12] = 0;	// sin entrelazado
+		escribeTrozo("IHDR", ihdr, 13);
+		if (tipo == INDEXADO && paleta != nullptr){
+			std::vector<sf::Uint8> plte;
+			for (size_t i = 0; i < paleta->size(); ++i){
+				plte.push_back((*paleta)[i].r);
+				plte.push_back((*paleta)[i].g);
+				plte.push_back((*paleta)[i].b);
+			}
+			escribeTrozo("PLTE", &plte[0], plte.size());
+		}
+	}
+
+	/**
+	* Bytes de una fila sin filtrar
+	*/
+	static int bytesFila(int ancho, int profundidad, TipoColor tipo){
+		int muestras = (tipo == RGB) ? 3 : 1;
+		return (ancho * muestras * profundidad + 7) / 8;
+	}
+
+	/**
+	* Bytes por pixel para los filtros (1 como minimo)
+	*/
+	static int bytesPixel(int profundidad, TipoColor tipo){
+		int muestras = (tipo == RGB) ? 3 : 1;
+		int b = muestras * profundidad / 8;
+		return (b < 1) ? 1 : b;
+	}
+
+	/**
+	* Anade una fila ya filtrada (el byte de filtro y la fila, ver FiltroPng)
+	*/
+	void fila(const sf::Uint8 *datos, size_t n){
+		compresor.comprime(datos, n);
+		vuelca(false);
+	}
+
+	/**
+	* Cierra la imagen. Devuelve false si ha habido algun error al escribir
+	*/
+	bool termina(){
+		compresor.termina();
+		vuelca(true);
+		escribeTrozo("IEND", nullptr, 0);
+		salida.flush();
+		return !!salida;
+	}
+};
+
+/*
+* Lee un PNG de un istream fila a fila: la cabecera con abre() y cada fila, ya sin filtro, con fila(). Los datos se
+* descomprimen segun se piden, asi que solo se guarda la fila anterior (la que necesitan los filtros).
+* No se admiten imagenes entrelazadas, y los CRC de los trozos no se comprueban (los datos comprimidos ya llevan su
+* propia suma de comprobacion)
+*/
+class LectorPng {
+private:
+
+	std::istream &entrada;
+	int ancho, alto, profundidad, tipo;
+	int bytesFila, bytesPixel;
+	sf::Uint32 quedan;			// Bytes sin leer del trozo IDAT actual
+	bool finDatos;				// Ya ha pasado el ultimo IDAT
+	Descompresor descompresor;
+	std::vector<sf::Uint8> anterior, cruda;
+
+	static sf::Uint32 lee32(const sf::Uint8 *p){
+		return ((sf::Uint32)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	}
+
+	/**
+	* Lee la cabecera de un trozo (longitud y tipo)
+	*/
+	bool leeTrozo(sf::Uint32 &longitud, char tipo[4]){
+		sf::Uint8 c[8];
+		if (!entrada.read((char*)c, 8)) return false;
+		longitud = lee32(c);
+		memcpy(tipo, c + 4, 4);
+		return true;
+	}
+
+	/**
+	* Fuente del descompresor: los datos de los trozos IDAT seguidos, saltando lo que hay entre ellos
+	*/
+	size_t leeDatos(sf::Uint8 *p, size_t n){
+		while (quedan == 0){
+			if (finDatos) return 0;
+			char tipo[4];
+			entrada.ignore(4);	// CRC del trozo anterior
+			if (!leeTrozo(quedan, tipo) || memcmp(tipo, "IDAT", 4) != 0){
+				finDatos = true;
+				quedan = 0;
+				return 0;
+			}
+		}
+		size_t k = (n < quedan) ? n : quedan;
+		entrada.read((char*)p, k);
+		k = (size_t)entrada.gcount();
+		if (k == 0){
+			finDatos = true;
+			return 0;
+		}
+		quedan -= (sf::Uint32)k;
+		return k;
+	}
+
+	static sf::Uint8 paeth(int a, int b, int c){
+		int p = a + b - c;
+		int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+		if (pa <= pb && pa <= pc) return (sf::Uint8)a;
+		if (pb <= pc) return (sf::Uint8)b;
+		return (sf::Uint8)c;
+	}
+
+public:
+
+	LectorPng(std::istream &entrada) :
+		entrada(entrada),
+		ancho(0), alto(0), profundidad(0), tipo(0),
+		bytesFila(0), bytesPixel(0),
+		quedan(0),
+		finDatos(false),
+		descompresor([this](sf::Uint8 *p, size_t n){ return leeDatos(p, n); })
+	{
+	}
+
+	/**
+	* Lee la firma y la cabecera y se coloca al principio de los datos. Devuelve false si no es un PNG que se pueda leer
+	*/
+	bool abre(){
+		static const sf::Uint8 firma[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		sf::Uint8 f[8];
+		if (!entrada.read((char*)f, 8) || memcmp(f, firma, 8) != 0) return false;
+		sf::Uint32 longitud;
+		char nombre[4];
+		sf::Uint8 ihdr[13];
+		if (!leeTrozo(longitud, nombre) || memcmp(nombre, "IHDR", 4) != 0 || longitud != 13 ||
+			!entrada.read((char*)ihdr, 13)){
+			return false;
+		}
+		ancho = (int)lee32(ihdr);
+		alto = (int)lee32(ihdr + 4);
+		profundidad = ihdr[8];
+		tipo = ihdr[9];
+		if (ancho <= 0 || alto <= 0 || ihdr[10] != 0 || ihdr[11] != 0 || ihdr[12] != 0){
+			return false;
+		}
+		int muestras = (tipo == 2) ? 3 : (tipo == 4) ? 2 : (tipo == 6) ? 4 : 1;
+		bytesFila = (int)(((sf::Int64)ancho * muestras * profundidad + 7) / 8);
+		bytesPixel = (std::max)(1, muestras * profundidad / 8);
+		anterior.assign(bytesFila, 0);
+		cruda.resize(bytesFila + 1);
+		// Se salta todo hasta el primer IDAT (paleta, texto...)
+		entrada.ignore(4);
+		for (;;){
+			if (!leeTrozo(quedan, nombre)) return false;
+			if (memcmp(nombre, "IDAT", 4) == 0) return true;
+			if (memcmp(nombre, "IEND", 4) == 0) return false;
+			entrada.ignore((std::streamsize)quedan + 4);
+		}
+	}
+
+	int getAncho() const{ return ancho; }
+	int getAlto() const{ return alto; }
+	int getProfundidad() const{ return profundidad; }
+
+	/**
+	* Tipo de color de PNG: 0 gris, 2 RGB, 3 indexado, 4 gris con alfa, 6 RGBA (ver EscritorPng::TipoColor)
+	*/
+	int getTipo() const{ return tipo; }
+
+	/**
+	* Deja en fila la siguiente fila sin filtrar (getAncho() pixeles, con las muestras de 16 bits en big-endian).
+	* Devuelve false si los datos estan mal o se han acabado
+	*/
+	bool fila(std::vector<sf::Uint8> &fila){
+		if (descompresor.descomprime(&cruda[0], cruda.size()) != cruda.size()) return false;
+		fila.resize(bytesFila);
+		const sf::Uint8 *d = &cruda[1];
+		const sf::Uint8 *arriba = &anterior[0];
+		int bpp = bytesPixel;
+		switch (cruda[0]){
+		case 0:
+			memcpy(&fila[0], d, bytesFila);
+			break;
+		case 1:
+			for (int i = 0; i < bytesFila; ++i) fila[i] = (sf::Uint8)(d[i] + ((i >= bpp) ? fila[i - bpp] : 0));
+			break;
+		case 2:
+			for (int i = 0; i < bytesFila; ++i) fila[i] = (sf::Uint8)(d[i] + arriba[i]);
+			break;
+		case 3:
+			for (int i = 0; i < bytesFila; ++i) fila[i] = (sf::Uint8)(d[i] + ((((i >= bpp) ? fila[i - bpp] : 0) + arriba[i]) >> 1));
+			break;
+		case 4:
+			for (int i = 0; i < bytesFila; ++i){
+				int izq = (i >= bpp) ? fila[i - bpp] : 0;
+				int diag = (i >= bpp) ? arriba[i - bpp] : 0;
+				fila[i] = (sf::Uint8)(d[i] + paeth(izq, arriba[i], diag));
+			}
+			break;
+		default:
+			return false;
+		}
+		memcpy(&anterior[0], &fila[0], bytesFila);
+		return true;
+	}
+};
+
+#endif
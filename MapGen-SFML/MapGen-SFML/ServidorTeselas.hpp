@@ -0,0 +1,425 @@
+#ifndef SERVIDORTESELAS_HPP
+#define SERVIDORTESELAS_HPP
+
+#include <SFML\Graphics.hpp>
+#include <SFML\Network.hpp>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "Map.hpp"
+#include "Teselas.hpp"
+#include "Paralelo.hpp"
+
+/*
+* Servidor HTTP local para que otras herramientas (visores web, scripts) pidan teselas y alturas del mapa mientras
+* el programa esta abierto. Solo escucha en localhost. Atiende:
+*
+*	GET /teselas/z/x/y.png	La tesela z/x/y de la PiramideTeselas del mapa.
+*	GET /altura/x/y			La altura de la casilla (x, y), en texto.
+*	GET /info				Tamano del mapa, zoom maximo y lado de las teselas, en JSON.
+*
+* Un hilo acepta las conexiones y las pasa a un grupo de hilos que leen la peticion, la contestan y cierran la
+* conexion. Las teselas se codifican cuando se piden y se guardan en una cache en memoria (las menos usadas se
+* tiran al pasar del maximo). Si llegan a la vez varias peticiones de una tesela que no esta en la cache, solo una
+* la codifica y las demas esperan a que termine. Cada tesela lleva como ETag el hash de sus pixeles, asi un cliente
+* que ya la tiene recibe un 304 sin que se vuelva a enviar.
+*
+* Si el mapa cambia hay que llamar a invalida(): se rehace la piramide y se vacia la cache. Las teselas que se
+* codifiquen mientras el mapa cambia pueden salir mezcladas, pero no se quedan en la cache
+*/
+class ServidorTeselas {
+public:
+
+	struct Estadisticas {
+		sf::Uint64 peticiones;
+		sf::Uint64 aciertos;		// Teselas que ya estaban en la cache
+		sf::Uint64 codificadas;		// Teselas codificadas
+		sf::Uint64 agrupadas;		// Peticiones que han esperado a que otra codificara su tesela
+		size_t memoriaCache;
+	};
+
+private:
+
+	struct Tesela {
+		std::string png;
+		sf::Uint64 hash;
+	};
+
+	/*
+	* Tesela que esta codificando un hilo. Los que la piden mientras tanto esperan a que este lista
+	*/
+	struct Pendiente {
+		bool lista;
+		std::shared_ptr<const Tesela> tesela;
+
+		Pendiente() :
+			lista(false)
+		{
+		}
+	};
+
+	struct EntradaCache {
+		std::shared_ptr<const Tesela> tesela;
+		std::list<sf::Uint64>::iterator uso;
+	};
+
+	const Map &mapa;
+	int hilos;
+	size_t memoriaMaxima;
+
+	std::shared_ptr<const PiramideTeselas> piramide;
+	sf::Uint32 generacion;		// Sube con cada invalida(); lo codificado para una generacion anterior no se guarda
+
+	/* Cache: uso tiene las claves de la mas reciente a la menos usada */
+	std::mutex cerrojo;
+	std::condition_variable listas;
+	std::unordered_map<sf::Uint64, EntradaCache> cache;
+	std::list<sf::Uint64> uso;
+	size_t memoria;
+	std::map<sf::Uint64, std::shared_ptr<Pendiente> > pendientes;
+
+	sf::TcpListener escucha;
+	std::unique_ptr<ColaAcotada<std::unique_ptr<sf::TcpSocket> > > conexiones;
+	std::thread aceptador;
+	std::vector<std::thread> trabajadores;
+	std::atomic<bool> parar;
+	bool activo;
+
+	std::atomic<sf::Uint64> peticiones, aciertos, codificadas, agrupadas;
+
+	static const size_t TAM_MAXIMO_PETICION = 8192;
+
+	static sf::Uint64 clave(int z, int x, int y){
+		return ((sf::Uint64)z << 48) | ((sf::Uint64)x << 24) | (sf::Uint64)y;
+	}
+
+	/**
+	* Mete una tesela en la cache (cerrojo tiene que estar bloqueado) y tira las menos usadas si se pasa de memoria
+	*/
+	void guarda(sf::Uint64 k, const std::shared_ptr<const Tesela> &t){
+		if (cache.count(k) != 0) return;
+		uso.push_front(k);
+		EntradaCache &e = cache[k];
+		e.tesela = t;
+		e.uso = uso.begin();
+		memoria += t->png.size();
+		while (memoria > memoriaMaxima && uso.size() > 1){
+			auto it = cache.find(uso.back());
+			memoria -= it->second.tesela->png.size();
+			cache.erase(it);
+			uso.pop_back();
+		}
+	}
+
+	/**
+	* La tesela z/x/y (que tiene que existir): de la cache, esperando a otro hilo que ya la este codificando, o
+	* codificandola
+	*/
+	std::shared_ptr<const Tesela> tesela(int z, int x, int y){
+		sf::Uint64 k = clave(z, x, y);
+		std::unique_lock<std::mutex> l(cerrojo);
+		auto c = cache.find(k);
+		if (c != cache.end()){
+			uso.splice(uso.begin(), uso, c->second.uso);
+			++aciertos;
+			return c->second.tesela;
+		}
+		auto p = pendientes.find(k);
+		if (p != pendientes.end()){
+			std::shared_ptr<Pendiente> pendiente = p->second;
+			++agrupadas;
+			listas.wait(l, [&](){ return pendiente->lista; });
+			return pendiente->tesela;
+		}
+		std::shared_ptr<Pendiente> pendiente(new Pendiente());
+		pendientes[k] = pendiente;
+		std::shared_ptr<const PiramideTeselas> pir = piramide;
+		sf::Uint32 gen = generacion;
+		l.unlock();
+
+		std::shared_ptr<Tesela> t(new Tesela());
+		std::vector<sf::Uint8> pixeles;
+		t->hash = pir->pixeles(z, x, y, pixeles);
+		std::ostringstream png;
+		pir->png(pixeles, png);
+		t->png = png.str();
+		++codificadas;
+
+		l.lock();
+		if (gen == generacion){
+			pendientes.erase(k);
+			guarda(k, t);
+		}
+		pendiente->tesela = t;
+		pendiente->lista = true;
+		listas.notify_all();
+		return t;
+	}
+
+	/**
+	* Lee la peticion hasta la linea en blanco que termina las cabeceras. Devuelve false si el cliente no la manda
+	* entera en unos segundos, cierra la conexion o se pasa de TAM_MAXIMO_PETICION
+	*/
+	static bool leePeticion(sf::TcpSocket &s, std::string &peticion){
+		sf::SocketSelector selector;
+		selector.add(s);
+		char buffer[1024];
+		peticion.clear();
+		while (peticion.find("\r\n\r\n") == std::string::npos){
+			if (peticion.size() > TAM_MAXIMO_PETICION || !selector.wait(sf::seconds(5))) return false;
+			size_t leidos = 0;
+			if (s.receive(buffer, sizeof(buffer), leidos) != sf::Socket::Done) return false;
+			peticion.append(buffer, leidos);
+		}
+		return true;
+	}
+
+	static void responde(sf::TcpSocket &s, const std::string &estado, const std::string &tipo, const std::string &cuerpo,
+		const std::string &cabeceras = ""){
+		std::ostringstream r;
+		r << "HTTP/1.1 " << estado << "\r\n"
+			<< "Content-Type: " << tipo << "\r\n"
+			<< "Content-Length: " << cuerpo.size() << "\r\n"
+			<< "Access-Control-Allow-Origin: *\r\n"
+			<< "Connection: close\r\n"
+			<< cabeceras
+			<< "\r\n";
+		std::string respuesta = r.str();
+		respuesta += cuerpo;
+		s.send(respuesta.data(), respuesta.size());
+	}
+
+	static void noEncontrado(sf::TcpSocket &s){
+		responde(s, "404 Not Found", "text/plain", "No encontrado\n");
+	}
+
+	/**
+	* Lee n enteros separados por '/' al principio de texto (lo que siga al ultimo no importa: ".png", "?...").
+	* Devuelve false si falta alguno
+	*/
+	static bool numeros(const std::string &texto, int *v, int n){
+		size_t i = 0;
+		for (int k = 0; k < n; ++k){
+			if (k > 0){
+				if (i >= texto.size() || texto[i] != '/') return false;
+				++i;
+			}
+			size_t inicio = i;
+			sf::Int64 valor = 0;
+			while (i < texto.size() && texto[i] >= '0' && texto[i] <= '9' && i - inicio < 9){
+				valor = valor * 10 + (texto[i++] - '0');
+			}
+			if (i == inicio) return false;
+			v[k] = (int)valor;
+		}
+		return true;
+	}
+
+	/**
+	* Valor de la cabecera nombre (en minusculas, con los dos puntos) de la peticion, o "" si no esta
+	*/
+	static std::string cabecera(const std::string &peticion, const std::string &nombre){
+		std::string minusculas(peticion);
+		for (auto &c : minusculas){
+			if (c >= 'A' && c <= 'Z') c = c - 'A' + 'a';
+		}
+		size_t i = minusculas.find("\r\n" + nombre);
+		if (i == std::string::npos) return "";
+		i += 2 + nombre.size();
+		size_t fin = peticion.find("\r\n", i);
+		while (i < fin && peticion[i] == ' ') ++i;
+		return peticion.substr(i, fin - i);
+	}
+
+	void atiende(sf::TcpSocket &s){
+		std::string peticion;
+		if (!leePeticion(s, peticion)) return;
+		++peticiones;
+		std::istringstream linea(peticion.substr(0, peticion.find("\r\n")));
+		std::string metodo, ruta;
+		linea >> metodo >> ruta;
+		if (metodo != "GET"){
+			responde(s, "405 Method Not Allowed", "text/plain", "Solo se admite GET\n", "Allow: GET\r\n");
+			return;
+		}
+		std::shared_ptr<const PiramideTeselas> pir;
+		{
+			std::lock_guard<std::mutex> l(cerrojo);
+			pir = piramide;
+		}
+		int v[3];
+		if (ruta.compare(0, 9, "/teselas/") == 0 && numeros(ruta.substr(9), v, 3)){
+			int z = v[0], x = v[1], y = v[2];
+			if (z > pir->getZoomMaximo() || x >= (1 << z) || y >= (1 << z)){
+				noEncontrado(s);
+				return;
+			}
+			std::shared_ptr<const Tesela> t = tesela(z, x, y);
+			std::ostringstream etag;
+			etag << "\"" << std::hex << t->hash << "\"";
+			std::string cabeceras = "ETag: " + etag.str() + "\r\nCache-Control: no-cache\r\n";
+			if (cabecera(peticion, "if-none-match:") == etag.str()){
+				responde(s, "304 Not Modified", "image/png", "", cabeceras);
+			}
+			else{
+				responde(s, "200 OK", "image/png", t->png, cabeceras);
+			}
+		}
+		else if (ruta.compare(0, 8, "/altura/") == 0 && numeros(ruta.substr(8), v, 2)){
+			if (v[0] >= mapa.getSize() || v[1] >= mapa.getSize()){
+				noEncontrado(s);
+				return;
+			}
+			std::ostringstream h;
+			h << mapa.getMapa()[v[0] + mapa.getSize() * v[1]] << "\n";
+			responde(s, "200 OK", "text/plain", h.str());
+		}
+		else if (ruta == "/info"){
+			std::ostringstream info;
+			info << "{\"size\": " << mapa.getSize() << ", \"zoomMaximo\": " << pir->getZoomMaximo()
+				<< ", \"lado\": " << PiramideTeselas::LADO << "}\n";
+			responde(s, "200 OK", "application/json", info.str());
+		}
+		else{
+			noEncontrado(s);
+		}
+	}
+
+	void acepta(){
+		sf::SocketSelector selector;
+		selector.add(escucha);
+		while (!parar){
+			if (!selector.wait(sf::milliseconds(200))) continue;
+			std::unique_ptr<sf::TcpSocket> s(new sf::TcpSocket());
+			if (escucha.accept(*s) != sf::Socket::Done) continue;
+			if (!conexiones->mete(std::move(s))) break;
+		}
+	}
+
+	void trabaja(){
+		std::unique_ptr<sf::TcpSocket> s;
+		while (conexiones->saca(s)){
+			atiende(*s);
+			s->disconnect();
+			s.reset();
+		}
+	}
+
+public:
+
+	/**
+	* Servidor de las teselas de mapa, con hilos para atender peticiones (0: uno por nucleo) y una cache de como mucho
+	* memoriaCache bytes de PNG. El mapa tiene que existir mientras exista el servidor. No escucha (ni prepara la
+	* piramide) hasta arranca()
+	*/
+	ServidorTeselas(const Map &mapa, int hilos = 0, size_t memoriaCache = 64 << 20) :
+		mapa(mapa),
+		hilos(hilos),
+		memoriaMaxima(memoriaCache),
+		generacion(0),
+		memoria(0),
+		parar(false),
+		activo(false),
+		peticiones(0),
+		aciertos(0),
+		codificadas(0),
+		agrupadas(0)
+	{
+		if (this->hilos <= 0){
+			this->hilos = (std::max)(1, (int)std::thread::hardware_concurrency());
+		}
+	}
+
+	~ServidorTeselas(){
+		para();
+	}
+
+	ServidorTeselas(const ServidorTeselas&) = delete;
+	ServidorTeselas &operator=(const ServidorTeselas&) = delete;
+
+	/**
+	* Empieza a escuchar en localhost:puerto. Devuelve false si no se puede (por ejemplo, el puerto esta ocupado)
+	*/
+	bool arranca(unsigned short puerto){
+		if (activo) return true;
+		if (escucha.listen(puerto, sf::IpAddress::LocalHost) != sf::Socket::Done){
+			std::cout << "Servidor de teselas: no se puede escuchar en el puerto " << puerto << std::endl;
+			return false;
+		}
+		if (!piramide){
+			piramide.reset(new PiramideTeselas(mapa));
+		}
+		parar = false;
+		conexiones.reset(new ColaAcotada<std::unique_ptr<sf::TcpSocket> >(4 * hilos));
+		for (int h = 0; h < hilos; ++h){
+			trabajadores.push_back(std::thread(&ServidorTeselas::trabaja, this));
+		}
+		aceptador = std::thread(&ServidorTeselas::acepta, this);
+		activo = true;
+		return true;
+	}
+
+	/**
+	* Deja de escuchar. Las peticiones que ya se han aceptado se terminan de atender.
+	* La piramide apunta a las alturas del mapa, que mientras esta parado pueden cambiar de sitio (ArchivoMapa::guarda),
+	* asi que se suelta y arranca() la vuelve a hacer
+	*/
+	void para(){
+		if (!activo) return;
+		parar = true;
+		aceptador.join();
+		conexiones->cierra();
+		for (auto &t : trabajadores){
+			t.join();
+		}
+		trabajadores.clear();
+		escucha.close();
+		activo = false;
+		std::lock_guard<std::mutex> l(cerrojo);
+		piramide.reset();
+	}
+
+	bool estaActivo() const{
+		return activo;
+	}
+
+	/**
+	* El mapa ha cambiado: olvida las teselas codificadas y rehace la piramide (si el servidor esta parado, la
+	* rehara al arrancar)
+	*/
+	void invalida(){
+		std::shared_ptr<const PiramideTeselas> nueva;
+		if (activo){
+			nueva.reset(new PiramideTeselas(mapa));
+		}
+		std::lock_guard<std::mutex> l(cerrojo);
+		piramide = nueva;
+		++generacion;
+		cache.clear();
+		uso.clear();
+		memoria = 0;
+		pendientes.clear();
+	}
+
+	Estadisticas getEstadisticas(){
+		Estadisticas e;
+		e.peticiones = peticiones;
+		e.aciertos = aciertos;
+		e.codificadas = codificadas;
+		e.agrupadas = agrupadas;
+		std::lock_guard<std::mutex> l(cerrojo);
+		e.memoriaCache = memoria;
+		return e;
+	}
+};
+
+#endif
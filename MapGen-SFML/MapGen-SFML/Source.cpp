@@ -1,15 +1,33 @@
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <math.h>
+#include <memory>
 #include <Windows.h>
 #include <windows.system.h>
 #include "Map.hpp"
+#include "ArchivoMapa.hpp"
+#include "CacheMapas.hpp"
+#include "Exportador.hpp"
+#include "ExportadorMalla.hpp"
+#include "Teselas.hpp"
+#include "Historial.hpp"
+#include "MapaCompartido.hpp"
+#include "ServidorTeselas.hpp"
+#include "Distribuido.hpp"
 #include "Conversor.hpp"
+#include "Malla.hpp"
+#include "Triangulacion.hpp"
 #include "Ventana.hpp"
 
 using namespace std;
 
-int main() {
+int main(int argc, char *argv[]) {
+	// MapGen-SFML --trabajador servidor puerto: sin ventana, genera teselas de mundo para un Coordinador
+	if (argc == 4 && std::string(argv[1]) == "--trabajador"){
+		return Trabajador::ejecuta(sf::IpAddress(argv[2]), (unsigned short)atoi(argv[3])) ? 0 : 1;
+	}
+
 	// Create window object
 	sf::RenderWindow window(sf::VideoMode(600, 600), "MountDet");
 
@@ -23,7 +41,33 @@ int main() {
 	// Set window frame rate
 	window.setFramerateLimit(60);
 
-	Map m(8);
+	// Si hay un mapa guardado (tecla G) se abre ese en vez de generar uno nuevo
+	// Los mapas generados se guardan en una cache (hasta 1 GB), asi una misma semilla solo se genera una vez
+	CacheMapas cache("cache", 1ULL << 30);
+	// El primer MapGen que se abre publica su mapa en memoria compartida; los siguientes muestran ese mismo mapa
+	// (y sus cambios) en vez de generar otro
+	LectorMapa lector;
+	std::unique_ptr<PublicadorMapa> publicador;
+	std::unique_ptr<Map> mapa;
+	if (lector.abre("MapGen")){
+		mapa.reset(lector.carga());
+	}
+	if (!mapa){
+		lector.cierra();
+		mapa.reset(ArchivoMapa::carga("mapa.mgs"));
+		if (!mapa){
+			mapa.reset(new Map(8));
+			mapa->setAlmacen(&cache);
+			mapa->generate(7);
+		}
+		publicador.reset(new PublicadorMapa("MapGen", mapa->getDetalle()));
+		publicador->publica(*mapa);
+	}
+	Map &m = *mapa;
+	// Deshacer y rehacer los cambios en el terreno, con hasta 64 MB de historial
+	Historial historial(m, 64 << 20);
+	// Teselas y alturas por HTTP en localhost:8080 (tecla W)
+	ServidorTeselas servidor(m);
 
 	sf::Font f;
 	f.loadFromFile("C:/Windows/Fonts/Arial.ttf");
@@ -33,13 +77,21 @@ int main() {
 	t.setPosition(10, 10);
 
 	float alpha = 0;
-	m.generate(7);
 	bool rightButClicked = false;
 	int refRot = -1;
 	bool leftButClicked = false;
 	sf::Vector2f refMove;
 	int thres = 200;
 	float angle = 0;
+	Malla malla;
+	bool verMalla = false;
+	bool mallaIrregular = false;	// N: la triangulacion irregular en vez de la rejilla completa
+	bool mallaSucia = false;		// las alturas han cambiado desde que se construyo la malla
+	// Mundo que se genera en segundo plano (tecla D), para que la ventana siga respondiendo mientras tanto
+	std::unique_ptr<Coordinador> coordinador;
+	std::thread hiloMundo;
+	std::atomic<bool> generandoMundo(false);
+	float azimutSol = 315;
 	// Main window loops
 	while (window.isOpen()) {
 		// Create events object
@@ -79,6 +131,144 @@ int main() {
 			else if (event.type == sf::Event::KeyPressed){
 				auto k = event.key.code;
 				switch (k){
+				case sf::Keyboard::H:
+					m.setModoHorizonte(!m.getModoHorizonte());
+					break;
+				// La malla guarda los colores con la luz de cuando se construyo: cambiar la luz tambien la ensucia
+				case sf::Keyboard::L:
+					m.setSombreado(!m.getSombreado());
+					m.setSol(azimutSol, 45);
+					mallaSucia = true;
+					break;
+				case sf::Keyboard::K:
+					azimutSol = fmod(azimutSol + 15, 360);
+					m.setSol(azimutSol, 45);
+					mallaSucia = true;
+					break;
+				case sf::Keyboard::O:
+					m.setSombras(!m.getSombras());
+					mallaSucia = true;
+					break;
+				case sf::Keyboard::P:
+					m.setOclusion(!m.getOclusion());
+					mallaSucia = true;
+					break;
+				case sf::Keyboard::G:
+				{
+					// Si el mapa se abrio de mapa.mgs, guardarlo encima cambia de sitio sus alturas (ver ArchivoMapa):
+					// el servidor de teselas no puede estar leyendolas mientras
+					bool servidorActivo = servidor.estaActivo();
+					if (servidorActivo){
+						servidor.para();
+					}
+					ArchivoMapa::guarda(m, "mapa.mgs");
+					servidor.invalida();
+					if (servidorActivo){
+						servidor.arranca(8080);
+					}
+					break;
+				}
+				case sf::Keyboard::E:
+					Exportador::png16(m, "mapa.png");
+					Exportador::pngColor(m, "mapa_color.png");
+					break;
+				case sf::Keyboard::X:
+					// La malla completa en PLY y una simplificada (error de 2 unidades de altura como mucho) en OBJ
+					ExportadorMalla::ply(m, "mapa.ply");
+					ExportadorMalla::obj(m, "mapa.obj", 2);
+					{
+						// Y la triangulacion irregular con la misma tolerancia
+						std::vector<sf::Vector3f> puntos;
+						std::vector<sf::Uint32> triangulos;
+						Triangulacion(m).extrae(2, puntos, triangulos);
+						std::ofstream tin("mapa_tin.ply", std::ios::binary);
+						ExportadorMalla::ply(m, puntos, triangulos, tin);
+					}
+					break;
+				case sf::Keyboard::T:
+				{
+					PiramideTeselas piramide(m);
+					int escritas, saltadas;
+					piramide.exporta("teselas", escritas, saltadas);
+					cout << "Teselas: " << escritas << " escritas, " << saltadas << " sin cambios" << endl;
+					break;
+				}
+				case sf::Keyboard::R:
+				{
+					// Un MapGen que muestra el mapa de otro no lo edita: sus cambios los pisaria lector.actualiza
+					if (!publicador){
+						cout << "El mapa se edita en el MapGen que lo publica" << endl;
+						break;
+					}
+					// Rehace un sector de 33 x 33 casillas en un sitio al azar
+					int lado = 5, tam = (1 << lado) + 1;
+					int x = rand() % (m.getSize() - tam), y = rand() % (m.getSize() - tam);
+					historial.edita(x, y, x + tam - 1, y + tam - 1, [&](){
+						m.modificaSector(x, y, lado, 0.5f, 200);
+					});
+					publicador->publicaRegion(m, x, y, x + tam - 1, y + tam - 1);
+					servidor.invalida();
+					mallaSucia = true;
+					break;
+				}
+				case sf::Keyboard::Z:
+				case sf::Keyboard::Y:
+				{
+					if (!publicador){
+						cout << "El mapa se edita en el MapGen que lo publica" << endl;
+						break;
+					}
+					sf::IntRect r;
+					if ((k == sf::Keyboard::Z) ? historial.deshaz(&r) : historial.rehaz(&r)){
+						publicador->publicaRegion(m, r.left, r.top, r.left + r.width - 1, r.top + r.height - 1);
+						servidor.invalida();
+						mallaSucia = true;
+					}
+					break;
+				}
+				case sf::Keyboard::D:
+				{
+					if (generandoMundo){
+						cout << "Ya se esta generando un mundo" << endl;
+						break;
+					}
+					if (hiloMundo.joinable()){
+						hiloMundo.join();
+					}
+					// Mundo de 8 x 8 teselas de 1025 x 1025 con la semilla del mapa, con un trabajador por nucleo
+					Mundo::Parametros p = { 10, 8, 8, (sf::Uint32)m.getSeed(), 0.5f };
+					coordinador.reset(new Coordinador(p, "mundo"));
+					generandoMundo = true;
+					Coordinador *c = coordinador.get();
+					hiloMundo = std::thread([c, &generandoMundo](){
+						bool terminado = c->ejecuta((std::max)(1, (int)std::thread::hardware_concurrency()), 8081);
+						cout << (terminado ? "Mundo generado en el directorio mundo" : "El mundo no se ha terminado de generar")
+							<< endl;
+						generandoMundo = false;
+					});
+					cout << "Generando mundo en segundo plano" << endl;
+					break;
+				}
+				case sf::Keyboard::W:
+					if (servidor.estaActivo()){
+						servidor.para();
+						cout << "Servidor de teselas parado" << endl;
+					}
+					else if (servidor.arranca(8080)){
+						cout << "Servidor de teselas en http://localhost:8080/teselas/{z}/{x}/{y}.png" << endl;
+					}
+					break;
+				case sf::Keyboard::M:
+					verMalla = !verMalla;
+					mallaIrregular = false;
+					mallaSucia = true;
+					break;
+				case sf::Keyboard::N:
+					// Como M, pero con la triangulacion irregular (error de altura de 2 como mucho)
+					verMalla = !verMalla;
+					mallaIrregular = true;
+					mallaSucia = true;
+					break;
 				case sf::Keyboard::A:
 					sf::CircleShape cs(3);
 					cs.setOutlineColor(sf::Color::Red);
@@ -102,11 +292,37 @@ int main() {
 			angle = refRot - mouseX;
 			refRot = mouseX;
 			m.rotate(angle);
+			if (verMalla){
+				malla.proyecta(m);
+			}
+		}
+		// Cambios que ha publicado el otro MapGen
+		if (lector.abierto() && lector.actualiza(m)){
+			servidor.invalida();
+			mallaSucia = true;
+		}
+		// La malla se rehace solo cuando se ve y las alturas han cambiado (editar, deshacer, cambios del otro MapGen)
+		if (verMalla && mallaSucia){
+			if (mallaIrregular){
+				std::vector<sf::Vector3f> puntos;
+				std::vector<sf::Uint32> triangulos;
+				Triangulacion(m).extrae(2, puntos, triangulos);
+				malla.construye(m, puntos, triangulos);
+			}
+			else{
+				malla.construye(m);
+			}
+			mallaSucia = false;
 		}
 		// Clear window
 		window.clear(sf::Color::Black);
 		window.setView(view);
-		window.draw(m);
+		if (verMalla){
+			window.draw(malla);
+		}
+		else{
+			window.draw(m);
+		}
 		//window.draw(t);
 
 		for (auto &c : circles){
@@ -116,5 +332,11 @@ int main() {
 		window.display();
 	}
 
+	// Si se cierra la ventana con un mundo a medias, se para (lo guardado sirve para reanudarlo con D)
+	if (hiloMundo.joinable()){
+		coordinador->cancela();
+		hiloMundo.join();
+	}
+
 	return 0;
 }
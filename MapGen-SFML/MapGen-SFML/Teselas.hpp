@@ -0,0 +1,223 @@
+#ifndef TESELAS_HPP
+#define TESELAS_HPP
+
+#include <SFML\Graphics.hpp>
+#include <Windows.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include "Map.hpp"
+#include "Png.hpp"
+#include "Paralelo.hpp"
+
+/*
+* Piramide de teselas de un mapa para verlo con zoom en herramientas web: en el zoom z el mapa entero ocupa
+* 2^z x 2^z teselas de LADO x LADO pixeles, en el esquema z/x/y habitual (x hacia la derecha, y hacia abajo).
+* El zoom maximo es el primero en el que cada casilla del mapa ocupa como mucho un pixel; cada zoom inferior se
+* obtiene del siguiente haciendo la media de cada cuadrado de 2x2 pixeles.
+* Las teselas son PNG indexados con los colores de las alturas (Map::colorAltura, sin sombreado), como
+* Exportador::pngColor.
+*
+* El zoom maximo se lee directamente del mapa; los demas se calculan al crear la piramide y ocupan en total un
+* tercio de lo que ocupa el mapa. El mapa tiene que seguir existiendo mientras se use la piramide
+*/
+class PiramideTeselas {
+public:
+
+	static const int LADO = 256;
+
+private:
+
+	const float *map;
+	int size;
+	int zoomMaximo;
+	std::vector<sf::Color> paleta;
+
+	/* niveles[z] tiene las alturas del zoom z (para z < zoomMaximo), fila a fila, de LADO << z pixeles de lado */
+	std::vector<std::vector<float> > niveles;
+
+	/**
+	* Altura del pixel (x, y) del zoom maximo: la casilla que le corresponde (si el mapa es menor que una tesela se
+	* amplia)
+	*/
+	float muestra(int x, int y) const{
+		int lado = LADO << zoomMaximo;
+		if (lado != size - 1){
+			x = (int)((sf::Int64)x * (size - 1) / lado);
+			y = (int)((sf::Int64)y * (size - 1) / lado);
+		}
+		return map[x + size * y];
+	}
+
+	float altura(int z, int x, int y) const{
+		if (z == zoomMaximo) return muestra(x, y);
+		return niveles[z][x + (LADO << z) * y];
+	}
+
+	/**
+	* FNV-1a de 64 bits, acumulado sobre h
+	*/
+	static sf::Uint64 hash(const sf::Uint8 *p, size_t n, sf::Uint64 h){
+		for (size_t i = 0; i < n; ++i){
+			h ^= p[i];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+
+	static std::string clave(int z, int x, int y){
+		std::ostringstream s;
+		s << z << "/" << x << "/" << y;
+		return s.str();
+	}
+
+	/**
+	* Lee el indice de una exportacion anterior: una linea "z/x/y hash" por tesela
+	*/
+	static void leeIndice(const std::string &ruta, std::map<std::string, sf::Uint64> &indice){
+		std::ifstream f(ruta.c_str());
+		std::string nombre;
+		sf::Uint64 h;
+		while (f >> nombre >> std::hex >> h){
+			indice[nombre] = h;
+		}
+	}
+
+	static bool existe(const std::string &ruta){
+		return GetFileAttributesA(ruta.c_str()) != INVALID_FILE_ATTRIBUTES;
+	}
+
+public:
+
+	/**
+	* Prepara la piramide de un mapa ya generado o cargado. Los zooms inferiores se calculan en paralelo
+	*/
+	PiramideTeselas(const Map &mapa) :
+		map(mapa.getMapa()),
+		size(mapa.getSize()),
+		zoomMaximo(0),
+		paleta(256)
+	{
+		while ((LADO << zoomMaximo) < size - 1) ++zoomMaximo;
+		for (int h = 0; h < 256; ++h){
+			paleta[h] = mapa.colorAltura(h);
+		}
+		niveles.resize(zoomMaximo);
+		for (int z = zoomMaximo - 1; z >= 0; --z){
+			int lado = LADO << z;
+			niveles[z].resize((size_t)lado * lado);
+			float *nivel = &niveles[z][0];
+			paralelo(0, lado, [&](int y){
+				for (int x = 0; x < lado; ++x){
+					nivel[x + lado * y] = (altura(z + 1, 2 * x, 2 * y) + altura(z + 1, 2 * x + 1, 2 * y) +
+						altura(z + 1, 2 * x, 2 * y + 1) + altura(z + 1, 2 * x + 1, 2 * y + 1)) / 4;
+				}
+			});
+		}
+	}
+
+	int getZoomMaximo() const{
+		return zoomMaximo;
+	}
+
+	/**
+	* Deja en pixeles los LADO x LADO indices de la paleta (alturas redondeadas) de la tesela z/x/y.
+	* Devuelve un hash del contenido que cambia si cambia la imagen (incluidos los colores de la paleta)
+	*/
+	sf::Uint64 pixeles(int z, int x, int y, std::vector<sf::Uint8> &pixeles) const{
+		pixeles.resize(LADO * LADO);
+		for (int j = 0; j < LADO; ++j){
+			for (int i = 0; i < LADO; ++i){
+				float h = altura(z, x * LADO + i, y * LADO + j) + 0.5f;
+				pixeles[i + LADO * j] = (sf::Uint8)((h < 0) ? 0 : (h > 255) ? 255 : h);
+			}
+		}
+		sf::Uint64 h = 14695981039346656037ULL;
+		for (size_t c = 0; c < paleta.size(); ++c){
+			sf::Uint8 rgb[3] = { paleta[c].r, paleta[c].g, paleta[c].b };
+			h = hash(rgb, 3, h);
+		}
+		return hash(&pixeles[0], pixeles.size(), h);
+	}
+
+	/**
+	* Codifica como PNG los pixeles de una tesela (ver pixeles()) y escribe el resultado en salida
+	*/
+	void png(const std::vector<sf::Uint8> &pixeles, std::ostream &salida) const{
+		EscritorPng escritor(salida, LADO, LADO, 8, EscritorPng::INDEXADO, &paleta);
+		FiltroPng filtro(LADO, 1);
+		std::vector<sf::Uint8> fila;
+		for (int j = 0; j < LADO; ++j){
+			filtro.filtra(&pixeles[LADO * j], fila);
+			escritor.fila(&fila[0], fila.size());
+		}
+		escritor.termina();
+	}
+
+	/**
+	* Escribe todas las teselas en directorio\z\x\y.png, codificandolas en paralelo. Junto a ellas se guarda un
+	* indice con el hash de cada una: las teselas que no han cambiado desde la exportacion anterior (y siguen en el
+	* disco) no se vuelven a codificar ni a escribir.
+	* Devuelve false si alguna tesela no se ha podido escribir; escritas y saltadas cuentan las que se han escrito y
+	* las que no hacia falta escribir
+	*/
+	bool exporta(const std::string &directorio, int &escritas, int &saltadas) const{
+		std::string rutaIndice = directorio + "\\teselas.txt";
+		std::map<std::string, sf::Uint64> anterior;
+		leeIndice(rutaIndice, anterior);
+		CreateDirectoryA(directorio.c_str(), NULL);
+
+		std::ostringstream indice;
+		indice << std::hex;
+		escritas = 0;
+		saltadas = 0;
+		bool bien = true;
+		for (int z = 0; z <= zoomMaximo; ++z){
+			int n = 1 << z;
+			std::string dirZoom = directorio + "\\" + std::to_string(z);
+			CreateDirectoryA(dirZoom.c_str(), NULL);
+			for (int x = 0; x < n; ++x){
+				CreateDirectoryA((dirZoom + "\\" + std::to_string(x)).c_str(), NULL);
+			}
+			std::vector<sf::Uint64> hashes(n * n);
+			std::vector<char> estado(n * n, 0);	// 0 saltada, 1 escrita, 2 error
+			paralelo(0, n * n, [&](int t){
+				int x = t % n, y = t / n;
+				std::vector<sf::Uint8> p;
+				hashes[t] = pixeles(z, x, y, p);
+				std::string ruta = dirZoom + "\\" + std::to_string(x) + "\\" + std::to_string(y) + ".png";
+				auto it = anterior.find(clave(z, x, y));
+				if (it != anterior.end() && it->second == hashes[t] && existe(ruta)){
+					return;
+				}
+				std::ofstream f(ruta.c_str(), std::ios::binary | std::ios::trunc);
+				png(p, f);
+				estado[t] = f ? 1 : 2;
+			}, 1);
+			for (int t = 0; t < n * n; ++t){
+				if (estado[t] == 2){
+					std::cout << dirZoom << "\\" << t % n << "\\" << t / n << ".png: no se puede escribir" << std::endl;
+					bien = false;
+					continue;
+				}
+				if (estado[t] == 1) ++escritas;
+				else ++saltadas;
+				indice << clave(z, t % n, t / n) << " " << hashes[t] << "\n";
+			}
+		}
+
+		std::ofstream f(rutaIndice.c_str(), std::ios::trunc);
+		f << indice.str();
+		if (!f){
+			std::cout << rutaIndice << ": no se puede escribir" << std::endl;
+			return false;
+		}
+		return bien;
+	}
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef TRIANGULACION_HPP
+#define TRIANGULACION_HPP
+
+#include <SFML\Graphics.hpp>
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include "Map.hpp"
+#include "Paralelo.hpp"
+
+/*
+* Triangulacion irregular (TIN) del mapa con un error maximo de altura: pocos triangulos grandes en las llanuras y el
+* agua y muchos pequenos donde el terreno cambia, en vez de la rejilla completa.
+*
+* Es una RTIN (right-triangulated irregular network): se parte del cuadrado del mapa dividido en dos triangulos
+* rectangulos y cada triangulo se divide en dos por el punto medio de su hipotenusa mientras al cortar ahi quede
+* alguna casilla mas lejos que la tolerancia. Como el mapa es de lado 2^n + 1 los puntos medios son siempre casillas
+* (los mismos puntos que va calculando Diamond-Square).
+*
+* Al crearla se calcula una vez, de abajo arriba, el error de cada punto medio: lo que se separa del plano de los
+* triangulos que lo tienen en la hipotenusa la casilla de dentro que mas se separa, o el error de los puntos medios
+* de sus hijos (lo que sea mayor). Asi el error de un punto medio nunca es menor que el de los de dentro, y los dos
+* triangulos que comparten una hipotenusa se dividen o no a la vez, con lo que la malla no tiene grietas.
+* Despues se pueden sacar triangulaciones con distintas tolerancias sin volver a calcular nada
+*/
+class Triangulacion {
+private:
+
+	const float *map;
+	int size;
+	std::vector<float> errores;
+
+	static const int TRIANGULOS_POR_TROZO = 1 << 18;
+
+	float altura(int x, int y) const{
+		return map[x + size * y];
+	}
+
+	/**
+	* Vertices del triangulo id del arbol de triangulos: a y b son los extremos de la hipotenusa y c el angulo recto.
+	* Los bits de id, del mas bajo al mas alto, dicen cual de los dos triangulos iniciales es y despues que mitad se
+	* coge en cada division; el 1 mas alto solo marca el final. Los triangulos de un nivel tienen todos numeros mayores
+	* que los del nivel anterior
+	*/
+	void vertices(int id, int &ax, int &ay, int &bx, int &by, int &cx, int &cy) const{
+		int t = size - 1;
+		if (id & 1){
+			ax = 0; ay = 0; bx = t; by = t; cx = t; cy = 0;
+		}
+		else{
+			ax = t; ay = t; bx = 0; by = 0; cx = 0; cy = t;
+		}
+		while ((id >>= 1) > 1){
+			int mx = (ax + bx) >> 1, my = (ay + by) >> 1;
+			if (id & 1){
+				bx = ax; by = ay;
+				ax = cx; ay = cy;
+			}
+			else{
+				ax = bx; ay = by;
+				bx = cx; by = cy;
+			}
+			cx = mx; cy = my;
+		}
+	}
+
+	/**
+	* Divide el triangulo (a, b, c) mientras el error de su punto medio pase de la tolerancia y anade los triangulos
+	* que quedan, en sentido antihorario visto desde arriba (x, y, altura)
+	*/
+	void extrae(int ax, int ay, int bx, int by, int cx, int cy, float tolerancia,
+		std::vector<sf::Uint32> &vertice, std::vector<sf::Vector3f> &puntos, std::vector<sf::Uint32> &triangulos) const{
+		int mx = (ax + bx) >> 1, my = (ay + by) >> 1;
+		if (abs(ax - cx) + abs(ay - cy) > 1 && errores[mx + size * my] > tolerancia){
+			extrae(cx, cy, ax, ay, mx, my, tolerancia, vertice, puntos, triangulos);
+			extrae(bx, by, cx, cy, mx, my, tolerancia, vertice, puntos, triangulos);
+			return;
+		}
+		int x[3] = { ax, cx, bx }, y[3] = { ay, cy, by };
+		for (int k = 0; k < 3; ++k){
+			sf::Uint32 &v = vertice[x[k] + size * y[k]];
+			if (v == 0){
+				puntos.push_back(sf::Vector3f((float)x[k], (float)y[k], altura(x[k], y[k])));
+				v = (sf::Uint32)puntos.size();	// Se guarda + 1 para que 0 sea "sin vertice"
+			}
+			triangulos.push_back(v - 1);
+		}
+	}
+
+	/**
+	* Mayor diferencia entre la altura de las casillas que hay dentro del triangulo (a, b, c), bordes incluidos, y el
+	* plano que pasa por sus vertices
+	*/
+	float errorTriangulo(int ax, int ay, int bx, int by, int cx, int cy) const{
+		int d = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+		float ha = altura(ax, ay), hb = altura(bx, by), hc = altura(cx, cy);
+		float pb = (hb - ha) / d, pc = (hc - ha) / d;
+		int x0 = (std::min)(ax, (std::min)(bx, cx)), x1 = (std::max)(ax, (std::max)(bx, cx));
+		int y0 = (std::min)(ay, (std::min)(by, cy)), y1 = (std::max)(ay, (std::max)(by, cy));
+		float e = 0;
+		for (int y = y0; y <= y1; ++y){
+			for (int x = x0; x <= x1; ++x){
+				// Coordenadas baricentricas (multiplicadas por d) del punto respecto a b y c
+				int wb = (x - ax) * (cy - ay) - (y - ay) * (cx - ax);
+				int wc = (bx - ax) * (y - ay) - (by - ay) * (x - ax);
+				int wa = d - wb - wc;
+				bool dentro = (d > 0) ? (wa >= 0 && wb >= 0 && wc >= 0) : (wa <= 0 && wb <= 0 && wc <= 0);
+				if (dentro){
+					e = (std::max)(e, fabsf(ha + pb * wb + pc * wc - altura(x, y)));
+				}
+			}
+		}
+		return e;
+	}
+
+public:
+
+	/**
+	* Calcula el error de cada punto medio del mapa (tiene que tener ya sus alturas): el mayor error (ver
+	* errorTriangulo) de los dos triangulos que tienen ese punto en la hipotenusa, o el de los puntos medios de sus
+	* hijos si es mayor. Con eso, un triangulo que no se divide con una tolerancia esta de verdad dentro de ella.
+	* Los niveles van de los triangulos mas pequenos a los mas grandes, para tener los errores de los hijos antes que
+	* los del padre, y los triangulos de cada nivel se miden en paralelo
+	*/
+	Triangulacion(const Map &mapa) :
+		map(mapa.getMapa()),
+		size(mapa.getSize()),
+		errores((size_t)size * size, 0)
+	{
+		sf::Int64 lado = size - 1;
+		sf::Int64 fin = 2 * lado * lado;	// Los triangulos son los id de [2, fin)
+		std::vector<float> trozo;
+		int nivel = 0;
+		while (((sf::Int64)2 << nivel) < fin) ++nivel;
+		for (; nivel >= 1; --nivel){
+			sf::Int64 primero = (sf::Int64)1 << nivel, ultimo = (std::min)((sf::Int64)2 << nivel, fin);
+			for (sf::Int64 inicio = primero; inicio < ultimo; inicio += TRIANGULOS_POR_TROZO){
+				int n = (int)(std::min)((sf::Int64)TRIANGULOS_POR_TROZO, ultimo - inicio);
+				trozo.resize(n);
+				paralelo(0, n, [&](int k){
+					int ax, ay, bx, by, cx, cy;
+					vertices((int)(inicio + k), ax, ay, bx, by, cx, cy);
+					trozo[k] = errorTriangulo(ax, ay, bx, by, cx, cy);
+				}, 256);
+				for (int k = 0; k < n; ++k){
+					int ax, ay, bx, by, cx, cy;
+					vertices((int)(inicio + k), ax, ay, bx, by, cx, cy);
+					float &e = errores[((ax + bx) >> 1) + size * ((ay + by) >> 1)];
+					e = (std::max)(e, trozo[k]);
+					if (abs(ax - cx) + abs(ay - cy) > 2){
+						// Los hijos tambien tienen punto medio (los del ultimo nivel se dividen en casillas sueltas)
+						int izq = ((ax + cx) >> 1) + size * ((ay + cy) >> 1);
+						int dcha = ((bx + cx) >> 1) + size * ((by + cy) >> 1);
+						e = (std::max)(e, (std::max)(errores[izq], errores[dcha]));
+					}
+				}
+			}
+		}
+	}
+
+	/**
+	* Triangulacion con la tolerancia dada: ninguna casilla queda a mas de esa altura de la superficie de los
+	* triangulos. Deja en puntos los vertices (x, y, altura) y en triangulos tres indices por triangulo, como los
+	* recibe Malla::construye y ExportadorMalla
+	*/
+	void extrae(float tolerancia, std::vector<sf::Vector3f> &puntos, std::vector<sf::Uint32> &triangulos) const{
+		int t = size - 1;
+		std::vector<sf::Uint32> vertice((size_t)size * size, 0);
+		puntos.clear();
+		triangulos.clear();
+		extrae(0, 0, t, t, t, 0, tolerancia, vertice, puntos, triangulos);
+		extrae(t, t, 0, 0, 0, t, tolerancia, vertice, puntos, triangulos);
+	}
+};
+
+#endif
@@ -36,6 +36,28 @@ public:
 		}
 	}
 
+	/**
+	* Muestra una imagen (por ejemplo Conversor::getImagenPlanta) como un unico quad texturizado, ampliada
+	* pixelWidth veces al dibujarla
+	*/
+	void show(const sf::Image &imagen, int pixelWidth){
+		sf::Texture textura;
+		textura.loadFromImage(imagen);
+		sf::Sprite sprite(textura);
+		sprite.setScale((float)pixelWidth, (float)pixelWidth);
+		v.create(sf::VideoMode::getDesktopMode(), name);
+		while (v.isOpen()){
+			sf::Event event;
+			while (v.pollEvent(event)){
+				if (event.type == sf::Event::Closed)
+					v.close();
+			}
+			v.clear();
+			v.draw(sprite);
+			v.display();
+		}
+	}
+
 
 };
 